@@ -2,4 +2,6 @@ TEMPLATE = subdirs
 
 SUBDIRS += \
     orange \
-    orangectl
+    orangectl \
+    benchmark \
+    orangebench
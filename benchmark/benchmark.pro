@@ -0,0 +1,58 @@
+#-------------------------------------------------
+#
+# Micro benchmarks for the protocol hot paths
+#
+#-------------------------------------------------
+
+QT       += core network sql
+QT       -= gui
+
+TARGET = orange-benchmark
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ../orange
+
+SOURCES += main.cpp \
+    hotpaths.cpp \
+    ../orange/parser.cpp \
+    ../orange/epolldispatcher.cpp \
+    ../orange/client.cpp \
+    ../orange/group.cpp \
+    ../orange/groupset.cpp \
+    ../orange/symbols.cpp \
+    ../orange/asterisk.cpp \
+    ../orange/queue.cpp \
+    ../orange/statistics.cpp \
+    ../orange/framing.cpp \
+    ../orange/timingwheel.cpp \
+    ../orange/configuration.cpp \
+    ../orange/bufferpool.cpp \
+    ../orange/statefile.cpp \
+    ../orange/wakeup.cpp \
+    ../orange/metrics.cpp \
+    ../orange/tracer.cpp
+
+HEADERS += \
+    hotpaths.h \
+    ../orange/parser.h \
+    ../orange/epolldispatcher.h \
+    ../orange/client.h \
+    ../orange/group.h \
+    ../orange/groupset.h \
+    ../orange/symbols.h \
+    ../orange/asterisk.h \
+    ../orange/queue.h \
+    ../orange/statistics.h \
+    ../orange/framing.h \
+    ../orange/timingwheel.h \
+    ../orange/configuration.h \
+    ../orange/bufferpool.h \
+    ../orange/statefile.h \
+    ../orange/wakeup.h \
+    ../orange/channel.h \
+    ../orange/metrics.h \
+    ../orange/perthread.h \
+    ../orange/tracer.h
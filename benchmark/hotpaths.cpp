@@ -0,0 +1,288 @@
+#include <QCoreApplication>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QDataStream>
+
+#include <time.h>
+
+#include "client.h"
+#include "group.h"
+#include "asterisk.h"
+#include "wakeup.h"
+#include "channel.h"
+#include "hotpaths.h"
+
+static qint64 threadCpuTime()
+{
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+    return (qint64) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static Result result(QString name, qint64 operations, qint64 cpuTime, QJsonObject parameters = QJsonObject())
+{
+    Result result;
+    result.name = name;
+    result.operations = operations;
+    result.cpuTime = cpuTime;
+    result.parameters = parameters;
+
+    return result;
+}
+
+// Defaults only, no settings file is read
+static ConfigurationPointer configuration()
+{
+    QSettings settings("/dev/null", QSettings::IniFormat);
+
+    return ConfigurationPointer(new Configuration(&settings));
+}
+
+// Mirrors the stream written by Client::detach(), the only way to give a Client a level without a database
+static QByteArray session(QString username, Client::Level level, QString group, QByteArray pending = QByteArray())
+{
+    QByteArray session;
+    QDataStream stream(&session, QIODevice::WriteOnly);
+
+    Client::Phone phone;
+    phone.time = QDateTime::currentDateTime();
+    phone.status = "ready";
+    phone.active = false;
+    phone.outbound = false;
+
+    quint32 agentId = 1, agentExtenMapId = 0;
+    quint64 agentLogSessionId = 0, agentLogStatusId = 0;
+
+    stream << username << username << QString() << (QStringList() << group) << QStringList() << (qint32) level << (qint32) Client::Ready;
+    stream << phone.time << phone.status << phone.channel << phone.active << phone.outbound << phone.dnis;
+    stream << (int) 0 << (int) 0 << agentId << agentExtenMapId << agentLogSessionId << agentLogStatusId << QDateTime::currentDateTime();
+    stream << false << (qint32) Parser::Unknown << false << false << false << QString();
+    stream << pending;
+
+    Statistics().save(stream);
+
+    return session;
+}
+
+// A Client answering over a real loopback connection, its output piles up unread in the socket buffer
+class SendingClient : public Client
+{
+public:
+    explicit SendingClient(ConfigurationPointer configuration) :
+        Client(configuration)
+    {
+    }
+
+    using Client::switchToBinaryFraming;
+};
+
+Probe::Probe(QObject *parent) :
+    QObject(parent),
+    count(0)
+{
+}
+
+void Probe::onEventReceived(QString event, QVariantHash headers)
+{
+    Q_UNUSED(event)
+    Q_UNUSED(headers)
+
+    count++;
+}
+
+QList<Result> benchmarkSendAgentStatus(int messages)
+{
+    QList<Result> results;
+    QTcpServer server;
+
+    server.listen(QHostAddress::LocalHost);
+
+    Client::Phone phone;
+    phone.time = QDateTime::currentDateTime();
+    phone.status = "busy";
+    phone.channel = "SIP/5001-0000a1b2";
+    phone.active = true;
+    phone.outbound = false;
+    phone.dnis = "+6281234567890";
+
+    for (int binary = 0; binary < 2; ++binary) {
+        QTcpSocket peer;
+        peer.connectToHost(server.serverAddress(), server.serverPort());
+        server.waitForNewConnection(5000);
+
+        SendingClient client(configuration());
+        client.setSocket(server.nextPendingConnection());
+
+        if (binary)
+            client.switchToBinaryFraming();
+
+        int username = Symbols::intern("agent0042"),
+            fullname = Symbols::intern("Agent Forty Two"),
+            group = Symbols::intern("retention"),
+            address = Symbols::intern("10.0.3.42"),
+            extension = Symbols::intern("5042");
+
+        qint64 start = threadCpuTime();
+
+        for (int i = 0; i < messages; ++i)
+            client.sendAgentStatus(username, fullname, phone, 17, 2, group, phone.time, address, extension);
+
+        results << result(binary ? "client/send-agent-status-binary" : "client/send-agent-status-xml", messages, threadCpuTime() - start);
+    }
+
+    return results;
+}
+
+QList<Result> benchmarkClientParse(int messages)
+{
+    // Only actions answered without the database, the rest of Client::onSocketReadyRead is the same for every element
+    QByteArray mix;
+
+    for (int i = 0; i < messages; ++i) {
+        switch (i % 20) {
+        case 5:
+            mix += "<action type=\"status\"><status group=\"retention\" extension=\"5042\" ready=\"true\" outbound=\"false\" /></action>\n";
+            break;
+        case 10:
+            mix += "<action type=\"statistics\"><statistics group=\"retention\" window=\"hour\" /></action>\n";
+            break;
+        case 15:
+            mix += "<action type=\"ask-dial-authorization\"><ask-dial-authorization destination=\"+6281234567890\" customerid=\"42\" campaign=\"retention\" /></action>\n";
+            break;
+        default:
+            mix += "<beat>1</beat>\n";
+            break;
+        }
+    }
+
+    // The session carries the whole mix as input already received, the slot then parses it in one go
+    Client client(configuration());
+    client.resumeSession(new QTcpSocket, session("agent0042", Client::Agent, "retention", mix));
+
+    qint64 start = threadCpuTime();
+    QMetaObject::invokeMethod(&client, "onSocketReadyRead", Qt::DirectConnection);
+    qint64 time = threadCpuTime() - start;
+
+    QList<Result> results;
+    results << result("client/parse-command-mix", messages, time);
+
+    return results;
+}
+
+QList<Result> benchmarkAsteriskFrames(int frames)
+{
+    // Recorded from a production floor, the usual traffic of a call entering a queue and being answered
+    static const char *recorded[] = {
+        "Event: Newchannel\r\nPrivilege: call,all\r\nChannel: SIP/trunk-0000a1b2\r\nChannelState: 0\r\nChannelStateDesc: Down\r\n"
+        "CallerIDNum: 081234567890\r\nCallerIDName: \r\nAccountCode: \r\nExten: 1500\r\nContext: from-trunk\r\nUniqueid: 1478001234.1021\r\n\r\n",
+        "Event: VarSet\r\nPrivilege: dialplan,all\r\nChannel: SIP/trunk-0000a1b2\r\nVariable: QUEUENAME\r\nValue: retention\r\n"
+        "Uniqueid: 1478001234.1021\r\n\r\n",
+        "Event: QueueCallerJoin\r\nPrivilege: agent,all\r\nChannel: SIP/trunk-0000a1b2\r\nCallerIDNum: 081234567890\r\n"
+        "CallerIDName: unknown\r\nQueue: retention\r\nPosition: 3\r\nCount: 3\r\nUniqueid: 1478001234.1021\r\n\r\n",
+        "Event: QueueMemberStatus\r\nPrivilege: agent,all\r\nQueue: retention\r\nLocation: SIP/5042\r\nMemberName: agent0042\r\n"
+        "StateInterface: SIP/5042\r\nMembership: static\r\nPenalty: 0\r\nCallsTaken: 17\r\nLastCall: 1478001100\r\nStatus: 6\r\nPaused: 0\r\n\r\n",
+        "Event: AgentConnect\r\nPrivilege: agent,all\r\nQueue: retention\r\nUniqueid: 1478001234.1021\r\nChannel: SIP/5042-0000a1b3\r\n"
+        "Member: SIP/5042\r\nMemberName: agent0042\r\nHoldtime: 12\r\nBridgedChannel: SIP/trunk-0000a1b2\r\nRingtime: 4\r\n\r\n",
+        "Event: Hangup\r\nPrivilege: call,all\r\nChannel: SIP/trunk-0000a1b2\r\nUniqueid: 1478001234.1021\r\nCallerIDNum: 081234567890\r\n"
+        "CallerIDName: unknown\r\nCause: 16\r\nCause-txt: Normal Clearing\r\n\r\n"
+    };
+
+    int recordedCount = sizeof(recorded) / sizeof(recorded[0]);
+    QTcpServer server;
+
+    server.listen(QHostAddress::LocalHost);
+
+    Asterisk asterisk(0, server.serverAddress().toString(), server.serverPort());
+    Probe probe;
+
+    QObject::connect(&asterisk, SIGNAL(eventReceived(QString,QVariantHash)), &probe, SLOT(onEventReceived(QString,QVariantHash)));
+
+    asterisk.login("benchmark", "benchmark");
+    server.waitForNewConnection(5000);
+
+    QTcpSocket *peer = server.nextPendingConnection();
+    peer->write("Asterisk Call Manager/5.0.1\r\n");
+
+    // Written in chunks the socket buffers take at once, only the reading side is timed
+    qint64 time = 0;
+    int sent = 0;
+
+    while (sent < frames) {
+        QByteArray chunk;
+
+        for (; sent < frames && chunk.size() < 65536; ++sent)
+            chunk += recorded[sent % recordedCount];
+
+        peer->write(chunk);
+        peer->waitForBytesWritten(5000);
+
+        qint64 start = threadCpuTime();
+
+        while (probe.count < sent)
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+
+        time += threadCpuTime() - start;
+    }
+
+    delete peer;
+
+    QList<Result> results;
+    results << result("asterisk/read-recorded-frames", frames, time);
+
+    return results;
+}
+
+QList<Result> benchmarkGroupBroadcast(QList<int> sizes)
+{
+    QList<Result> results;
+    ConfigurationPointer shared = configuration();
+
+    foreach (int size, sizes) {
+        Wakeup wakeup;
+        Channel<Client::Delivery> deliveries(&wakeup);
+        Group group("retention");
+        QList<Client *> members;
+
+        // Supervisors of equal level exchange nothing while joining, only the agent broadcast below fans out
+        for (int i = 0; i < size; ++i) {
+            Client *member = new Client(shared);
+            member->resumeSession(new QTcpSocket, session(QString("supervisor%1").arg(i), Client::Supervisor, "retention"));
+            member->setChannels(NULL, &deliveries);
+
+            group.addMember(member);
+            members << member;
+        }
+
+        Client agent(shared);
+        agent.resumeSession(new QTcpSocket, session("agent0042", Client::Agent, "retention"));
+
+        // Batches fit the channel, it is drained outside the timed part as the workers would
+        int batch = qMax(32768 / size, 1),
+            broadcasts = qMax(200000 / size, 20);
+        qint64 time = 0;
+        Client::Delivery delivery;
+
+        for (int done = 0; done < broadcasts; done += batch) {
+            qint64 start = threadCpuTime();
+
+            for (int i = done; i < qMin(done + batch, broadcasts); ++i)
+                group.broadcastAgentStatus(&agent);
+
+            time += threadCpuTime() - start;
+
+            while (deliveries.pop(&delivery))
+                ;
+        }
+
+        QJsonObject parameters;
+        parameters["group_size"] = size;
+        parameters["cpu_ns_per_delivery"] = (double) time / ((qint64) broadcasts * size);
+
+        results << result("group/broadcast-agent-status", broadcasts, time, parameters);
+
+        qDeleteAll(members);
+    }
+
+    return results;
+}
@@ -0,0 +1,35 @@
+#ifndef HOTPATHS_H
+#define HOTPATHS_H
+
+#include <QObject>
+#include <QVariantHash>
+#include <QJsonObject>
+#include <QList>
+
+// CPU time spent by one benchmark over a number of operations
+struct Result {
+    QString name;
+    qint64 operations, cpuTime; // cpuTime in nsecs
+    QJsonObject parameters;
+};
+
+// Counts what the measured object emits
+class Probe : public QObject
+{
+    Q_OBJECT
+
+public:
+    int count;
+
+    explicit Probe(QObject *parent = 0);
+
+public slots:
+    void onEventReceived(QString event, QVariantHash headers);
+};
+
+QList<Result> benchmarkSendAgentStatus(int messages);
+QList<Result> benchmarkClientParse(int messages);
+QList<Result> benchmarkAsteriskFrames(int frames);
+QList<Result> benchmarkGroupBroadcast(QList<int> sizes);
+
+#endif // HOTPATHS_H
@@ -0,0 +1,332 @@
+#include <time.h>
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QXmlStreamReader>
+#include <QTextStream>
+#include <QSocketNotifier>
+#include <QSemaphore>
+#include <QThread>
+#include <QJsonDocument>
+
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "epolldispatcher.h"
+#include "hotpaths.h"
+
+static qint64 threadCpuTime()
+{
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+    return (qint64) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Typical desktop traffic: mostly heartbeats, with the occasional status change and dial request
+static QList<QByteArray> commandMix(int count)
+{
+    QList<QByteArray> messages;
+
+    for (int i = 0; i < count; ++i) {
+        switch (i % 20) {
+        case 5:
+            messages << "<action type=\"ready\"><ready value=\"true\" outbound=\"false\" /></action>\n";
+            break;
+        case 10:
+            messages << "<action type=\"ready\"><ready value=\"false\" mode=\"aux\" outbound=\"false\" /></action>\n";
+            break;
+        case 15:
+            messages << "<action type=\"ask-dial-authorization\"><ask-dial-authorization destination=\"+6281234567890\" customerid=\"42\" campaign=\"retention\" /></action>\n";
+            break;
+        default:
+            messages << "<beat>1</beat>\n";
+            break;
+        }
+    }
+
+    return messages;
+}
+
+// The reader loop Client used before the fast parser, kept here as the baseline
+static int parseGeneric(const QList<QByteArray> &messages)
+{
+    QXmlStreamReader reader;
+    int handled = 0;
+
+    reader.addData("<?xml version=\"1.0\"?><stream>");
+
+    foreach (const QByteArray &message, messages) {
+        reader.addData(message);
+
+        while (!reader.atEnd()) {
+            QXmlStreamReader::TokenType tokenType = reader.readNext();
+
+            if (tokenType != QXmlStreamReader::StartElement)
+                continue;
+
+            QString elementName = reader.name().toString();
+            QXmlStreamAttributes attributes = reader.attributes();
+
+            if (elementName == "beat") {
+                reader.readElementText();
+                handled++;
+            } else if (elementName == "action") {
+                QString actionType = attributes.value("type").toString();
+
+                if (reader.readNextStartElement() && reader.name().toString() == actionType) {
+                    QXmlStreamAttributes actionAttributes = reader.attributes();
+                    handled++;
+
+                    Q_UNUSED(actionAttributes)
+                }
+            }
+        }
+    }
+
+    return handled;
+}
+
+static int parseFast(const QList<QByteArray> &messages)
+{
+    Parser parser;
+    Parser::Token token;
+    Parser::Element actionElement = Parser::Unknown;
+    int handled = 0;
+
+    parser.append("<?xml version=\"1.0\"?><stream>");
+
+    foreach (const QByteArray &message, messages) {
+        parser.append(message);
+
+        while (parser.next(&token)) {
+            if (token.type != Parser::StartElement)
+                continue;
+
+            if (token.element == Parser::Beat) {
+                handled++;
+            } else if (token.element == Parser::Action) {
+                Parser::Slice actionType = Parser::attribute(token, "type");
+
+                actionElement = Parser::lookup(actionType.data, actionType.length);
+            } else if (token.element != Parser::Unknown && token.element == actionElement) {
+                QXmlStreamAttributes actionAttributes = Parser::attributes(token);
+                handled++;
+
+                Q_UNUSED(actionAttributes)
+            }
+        }
+
+        parser.compact();
+    }
+
+    return handled;
+}
+
+// Consumes the single byte written per event, like a client socket reading one small message
+class Sink : public QSocketNotifier
+{
+public:
+    struct Round {
+        int received, batch;
+        QSemaphore done;
+    };
+
+    Sink(int descriptor, Round *round) :
+        QSocketNotifier(descriptor, QSocketNotifier::Read),
+        round(round)
+    {
+    }
+
+protected:
+    bool event(QEvent *event)
+    {
+        if (event->type() != QEvent::SockAct)
+            return QSocketNotifier::event(event);
+
+        char byte;
+        ::read(socket(), &byte, 1);
+
+        if (++round->received == round->batch) {
+            round->received = 0;
+            round->done.release();
+        }
+
+        return true;
+    }
+
+private:
+    Round *round;
+};
+
+// A worker thread holding many mostly idle connections, on either event dispatcher
+class DispatcherThread : public QThread
+{
+public:
+    QSemaphore started;
+    clockid_t cpuClock;
+
+    DispatcherThread(const QList<int> &descriptors, Sink::Round *round, bool epoll) :
+        descriptors(descriptors),
+        round(round)
+    {
+        if (epoll)
+            setEventDispatcher(new EpollDispatcher);
+    }
+
+protected:
+    void run()
+    {
+        QList<Sink *> sinks;
+
+        foreach (int descriptor, descriptors)
+            sinks << new Sink(descriptor, round);
+
+        pthread_getcpuclockid(pthread_self(), &cpuClock);
+        started.release();
+
+        exec();
+
+        qDeleteAll(sinks);
+    }
+
+private:
+    QList<int> descriptors;
+    Sink::Round *round;
+};
+
+static qint64 cpuTime(clockid_t clock)
+{
+    timespec now;
+    clock_gettime(clock, &now);
+
+    return (qint64) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// One percent of the connections become readable per round, the rest stay idle as desktops between beats do
+static qint64 dispatch(bool epoll, int connections, int rounds, int *events)
+{
+    QList<int> readers, writers;
+
+    for (int i = 0; i < connections; ++i) {
+        int pair[2];
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0)
+            break;
+
+        readers << pair[0];
+        writers << pair[1];
+    }
+
+    Sink::Round round;
+    round.received = 0;
+    round.batch = qMax(readers.count() / 100, 1);
+
+    DispatcherThread thread(readers, &round, epoll);
+    thread.start();
+    thread.started.acquire();
+
+    qint64 start = cpuTime(thread.cpuClock);
+
+    for (int i = 0; i < rounds; ++i) {
+        for (int j = 0; j < round.batch; ++j)
+            ::write(writers.at((i * round.batch + j) % writers.count()), "x", 1);
+
+        round.done.acquire();
+    }
+
+    qint64 time = cpuTime(thread.cpuClock) - start;
+
+    thread.quit();
+    thread.wait();
+
+    foreach (int descriptor, readers + writers)
+        ::close(descriptor);
+
+    *events = rounds * round.batch;
+
+    return time;
+}
+
+// One JSON object per line, so that runs can be collected and compared by scripts
+static void printResult(QTextStream &out, const Result &result)
+{
+    QJsonObject line = result.parameters;
+    line["benchmark"] = result.name;
+    line["operations"] = result.operations;
+    line["cpu_ns_per_operation"] = (double) result.cpuTime / qMax(result.operations, (qint64) 1);
+
+    out << QJsonDocument(line).toJson(QJsonDocument::Compact) << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+    QStringList arguments = application.arguments();
+    QTextStream out(stdout);
+
+    int count = arguments.count() > 1 ? arguments.at(1).toInt() : 200000,
+        connections = arguments.count() > 2 ? arguments.at(2).toInt() : 2000;
+    QList<QByteArray> messages = commandMix(count);
+    QList<Result> results;
+
+    parseGeneric(messages);
+    parseFast(messages);
+
+    qint64 start = threadCpuTime();
+    int genericHandled = parseGeneric(messages);
+    qint64 genericTime = threadCpuTime() - start;
+
+    start = threadCpuTime();
+    int fastHandled = parseFast(messages);
+    qint64 fastTime = threadCpuTime() - start;
+
+    Result generic;
+    generic.name = "parser/generic";
+    generic.operations = genericHandled;
+    generic.cpuTime = genericTime;
+
+    Result fast;
+    fast.name = "parser/fast";
+    fast.operations = fastHandled;
+    fast.cpuTime = fastTime;
+
+    results << generic << fast;
+
+    // Agent statuses pile up unread in the socket buffer, a quarter of the messages keeps that in bounds
+    results << benchmarkSendAgentStatus(qMax(count / 4, 1));
+    results << benchmarkClientParse(count);
+    results << benchmarkAsteriskFrames(count);
+    results << benchmarkGroupBroadcast(QList<int>() << 10 << 50 << 100 << 500 << 1000 << 5000);
+
+    // Both ends of every connection are held open by this process
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    QJsonObject parameters;
+    parameters["connections"] = connections;
+
+    int events;
+    Result dispatcher;
+    dispatcher.parameters = parameters;
+
+    dispatcher.name = "dispatcher/qt";
+    dispatcher.cpuTime = dispatch(false, connections, 2000, &events);
+    dispatcher.operations = events;
+    results << dispatcher;
+
+    dispatcher.name = "dispatcher/epoll";
+    dispatcher.cpuTime = dispatch(true, connections, 2000, &events);
+    dispatcher.operations = events;
+    results << dispatcher;
+
+    foreach (const Result &result, results)
+        printResult(out, result);
+
+    return genericHandled == fastHandled ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+#include <QTimerEvent>
+#include <QDebug>
+
+#include "terminal.h"
+#include "admission.h"
+
+Admission::Admission(QObject *parent, int concurrency, int queueLimit, int timeout) :
+    QObject(parent),
+    concurrency(qMax(concurrency, 1)),
+    queueLimit(queueLimit),
+    timeout(timeout)
+{
+    timer.start(5000, this);
+
+    qDebug() << "Login admission initialized, concurrency:" BOLD BLUE << this->concurrency << RESET;
+}
+
+Admission::~Admission()
+{
+    qDebug("Login admission destroyed");
+}
+
+void Admission::setLevelHint(QString username, Client::Level level)
+{
+    levelHints.insert(username, level);
+}
+
+void Admission::setConcurrency(int concurrency)
+{
+    this->concurrency = qMax(concurrency, 1);
+
+    // Logins already admitted keep their slot, a raised limit lets queued ones in right away
+    admitNext();
+
+    qDebug() << "Login admission concurrency changed to:" BOLD BLUE << this->concurrency << RESET;
+}
+
+int Admission::getConcurrency()
+{
+    return concurrency;
+}
+
+int Admission::getActive()
+{
+    return active.count();
+}
+
+int Admission::getQueued()
+{
+    return queueLength();
+}
+
+void Admission::request(Client *client, QString username)
+{
+    if (queued.contains(client) || active.contains(client))
+        return;
+
+    if (active.count() < concurrency && queueLength() == 0) {
+        admit(client);
+
+        return;
+    }
+
+    if (queueLength() >= queueLimit) {
+        reject(client, "Server busy, retry later");
+
+        return;
+    }
+
+    // Supervisors and managers are admitted ahead of agents, the level is remembered from an earlier login
+    if (levelHints.value(username, Client::Agent) > Client::Agent)
+        superiorQueue.enqueue(client);
+    else
+        agentQueue.enqueue(client);
+
+    queued.insert(client, QDateTime::currentDateTime());
+
+    QMetaObject::invokeMethod(client, "sendAuthenticationQueued", Qt::QueuedConnection, Q_ARG(int, position(client)));
+}
+
+void Admission::release(Client *client)
+{
+    if (queued.remove(client) > 0) {
+        superiorQueue.removeOne(client);
+        agentQueue.removeOne(client);
+    }
+
+    if (active.remove(client) > 0)
+        admitNext();
+}
+
+void Admission::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != timer.timerId())
+        return;
+
+    QDateTime now = QDateTime::currentDateTime();
+
+    // A slot held by a stalled login is reclaimed so that a storm always drains in bounded time
+    QMutableHashIterator<Client *, QDateTime> admitted(active);
+    while (admitted.hasNext()) {
+        admitted.next();
+
+        if (admitted.value().secsTo(now) > timeout) {
+            qWarning("Login admission slot timed out");
+
+            admitted.remove();
+        }
+    }
+
+    QList<Client *> expired;
+
+    QHashIterator<Client *, QDateTime> waiting(queued);
+    while (waiting.hasNext()) {
+        waiting.next();
+
+        if (waiting.value().secsTo(now) > timeout)
+            expired << waiting.key();
+    }
+
+    foreach (Client *client, expired) {
+        release(client);
+        reject(client, "Login queue timeout, retry later");
+    }
+
+    admitNext();
+    notifyPositions();
+}
+
+int Admission::queueLength()
+{
+    return superiorQueue.count() + agentQueue.count();
+}
+
+int Admission::position(Client *client)
+{
+    int index = superiorQueue.indexOf(client);
+
+    if (index < 0) {
+        index = agentQueue.indexOf(client);
+
+        if (index >= 0)
+            index += superiorQueue.count();
+    }
+
+    return index + 1;
+}
+
+void Admission::admit(Client *client)
+{
+    active.insert(client, QDateTime::currentDateTime());
+
+    QMetaObject::invokeMethod(client, "authenticate", Qt::QueuedConnection);
+}
+
+void Admission::admitNext()
+{
+    while (active.count() < concurrency && queueLength() > 0) {
+        Client *client = !superiorQueue.isEmpty() ? superiorQueue.dequeue() : agentQueue.dequeue();
+
+        queued.remove(client);
+
+        admit(client);
+    }
+}
+
+void Admission::reject(Client *client, QString message)
+{
+    QMetaObject::invokeMethod(client, "sendAuthenticationRejected", Qt::QueuedConnection, Q_ARG(QString, message));
+}
+
+void Admission::notifyPositions()
+{
+    int position = 0;
+
+    foreach (Client *client, superiorQueue)
+        QMetaObject::invokeMethod(client, "sendAuthenticationQueued", Qt::QueuedConnection, Q_ARG(int, ++position));
+
+    foreach (Client *client, agentQueue)
+        QMetaObject::invokeMethod(client, "sendAuthenticationQueued", Qt::QueuedConnection, Q_ARG(int, ++position));
+}
@@ -0,0 +1,50 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <QObject>
+#include <QQueue>
+#include <QHash>
+#include <QDateTime>
+#include <QBasicTimer>
+
+#include "client.h"
+
+class Admission : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Admission(QObject *parent = 0, int concurrency = 8, int queueLimit = 2000, int timeout = 30);
+    ~Admission();
+
+    void setLevelHint(QString username, Client::Level level);
+    void setConcurrency(int concurrency);
+
+    int getConcurrency();
+    int getActive();
+    int getQueued();
+
+    void request(Client *client, QString username);
+    void release(Client *client);
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private:
+    int concurrency, queueLimit, timeout;
+    QHash<QString, Client::Level> levelHints; // key: Username
+    QQueue<Client *> superiorQueue, agentQueue;
+    QHash<Client *, QDateTime> queued; // value: time entering the queue
+    QHash<Client *, QDateTime> active; // value: time admitted
+    QBasicTimer timer;
+
+    int queueLength();
+    int position(Client *client);
+
+    void admit(Client *client);
+    void admitNext();
+    void reject(Client *client, QString message);
+    void notifyPositions();
+};
+
+#endif // ADMISSION_H
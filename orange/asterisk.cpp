@@ -2,12 +2,14 @@
 #include <QDebug>
 
 #include "terminal.h"
+#include "metrics.h"
 #include "asterisk.h"
 
 Asterisk::Asterisk(QObject *parent, QString host, quint16 port) :
     QObject(parent),
     host(host),
-    port(port)
+    port(port),
+    greeted(false)
 {
     connect(&socket, SIGNAL(disconnected()), SLOT(onSocketDisconnected()));
     connect(&socket, SIGNAL(error(QAbstractSocket::SocketError)), SLOT(onSocketError(QAbstractSocket::SocketError)));
@@ -21,28 +23,16 @@ Asterisk::~Asterisk()
     qDebug("Asterisk Manager destroyed");
 }
 
-QVariantHash Asterisk::login(QString username, QString secret)
+void Asterisk::login(QString username, QString secret)
 {
     this->username = username;
     this->secret = secret;
 
-    if (socket.state() != QTcpSocket::ConnectedState) {
-        socket.connectToHost(host, port);
-
-        if (socket.waitForConnected()) {
-            socket.blockSignals(true);
-
-            if (socket.waitForReadyRead())
-                qDebug() << "Asterisk Manager connected:" BOLD BLUE << socket.readLine() << RESET;
-
-            socket.blockSignals(false);
+    // Nothing waits here, the Login action goes out once the banner has arrived and loginFinished() tells the outcome
+    if (socket.state() == QTcpSocket::UnconnectedState) {
+        greeted = false;
 
-            QVariantHash headers;
-            headers["Username"] = username;
-            headers["Secret"] = secret;
-
-            return sendPacket("Login", headers);
-        }
+        socket.connectToHost(host, port);
     }
 }
 
@@ -61,6 +51,15 @@ QVariantHash Asterisk::sipPeers()
     return sendPacket("SIPpeers");
 }
 
+QVariantHash Asterisk::queueStatus(QString queue)
+{
+    QVariantHash headers;
+
+    insertNotEmpty(&headers, "Queue", queue);
+
+    return sendPacket("QueueStatus", headers);
+}
+
 QVariantHash Asterisk::originate(QString channel,
                                  QString exten,
                                  QString context,
@@ -74,6 +73,45 @@ QVariantHash Asterisk::originate(QString channel,
                                  bool earlyMedia,
                                  bool async,
                                  QStringList codecs)
+{
+    return sendPacket("Originate", originateHeaders(channel, exten, context, priority, application, data, timeout, callerId,
+                                                    variables, account, earlyMedia, async, codecs));
+}
+
+QString Asterisk::originateAsync(QString channel,
+                                 QString exten,
+                                 QString context,
+                                 uint priority,
+                                 QString application,
+                                 QString data,
+                                 uint timeout,
+                                 QString callerId,
+                                 QVariantHash variables)
+{
+    if (!isConnected())
+        return QString();
+
+    QString actionId = sendAction("Originate", originateHeaders(channel, exten, context, priority, application, data, timeout,
+                                                                callerId, variables, QString(), false, true, QStringList()));
+
+    asyncOriginates.insert(actionId);
+
+    return actionId;
+}
+
+QVariantHash Asterisk::originateHeaders(QString channel,
+                                        QString exten,
+                                        QString context,
+                                        uint priority,
+                                        QString application,
+                                        QString data,
+                                        uint timeout,
+                                        QString callerId,
+                                        QVariantHash variables,
+                                        QString account,
+                                        bool earlyMedia,
+                                        bool async,
+                                        QStringList codecs)
 {
     QVariantHash headers;
     headers["Channel"] = channel;
@@ -106,7 +144,7 @@ QVariantHash Asterisk::originate(QString channel,
         }
     }
 
-    return sendPacket("Originate", headers);
+    return headers;
 }
 
 QVariantHash Asterisk::playDtmf(QString channel, QChar digit)
@@ -144,6 +182,23 @@ QVariantHash Asterisk::redirect(QString channel, QString exten, QString context,
     return sendPacket("Redirect", headers);
 }
 
+void Asterisk::setIgnoredEvents(QStringList events)
+{
+    ignoredEvents = events.toSet();
+
+    qDebug() << "Ignored AMI events:" BOLD BLUE << events.join(",") << RESET;
+}
+
+bool Asterisk::isConnected()
+{
+    return socket.state() == QTcpSocket::ConnectedState;
+}
+
+int Asterisk::getPendingActions()
+{
+    return pendingActions.count();
+}
+
 void Asterisk::insertNotEmpty(QVariantHash *headers, QString key, QVariant value)
 {
     bool isEmpty = false;
@@ -179,7 +234,7 @@ QVariant Asterisk::decodeValue(QString string)
     return value;
 }
 
-QVariantHash Asterisk::sendPacket(QString action, QVariantHash headers)
+QString Asterisk::sendAction(QString action, QVariantHash headers)
 {
     QString actionId = QUuid::createUuid().toString();
 
@@ -196,44 +251,111 @@ QVariantHash Asterisk::sendPacket(QString action, QVariantHash headers)
 
         socket.write("\r\n");
         socket.flush();
-        socket.waitForReadyRead();
+
+        pendingActions.insert(actionId, qMakePair(action, Metrics::now()));
     }
 
+    return actionId;
+}
+
+QVariantHash Asterisk::sendPacket(QString action, QVariantHash headers)
+{
+    QString actionId = sendAction(action, headers);
+
+    if (socket.state() == QTcpSocket::ConnectedState)
+        socket.waitForReadyRead();
+
     return responses.take(actionId);
 }
 
 void Asterisk::onSocketDisconnected()
 {
-    ;
+    // Responses to these will never arrive
+    pendingActions.clear();
+
+    foreach (QString actionId, asyncOriginates)
+        emit originateFinished(actionId, false, "asterisk disconnected");
+
+    asyncOriginates.clear();
 }
 
 void Asterisk::onSocketError(QAbstractSocket::SocketError socketError)
 {
-    ;
+    Q_UNUSED(socketError);
+
+    // A failure before the login completed is reported as such, the caller decides when to retry
+    if (!greeted || !loginActionId.isEmpty()) {
+        loginActionId.clear();
+
+        emit loginFinished(false, socket.errorString());
+    }
 }
 
 void Asterisk::onSocketReadyRead()
 {
 //    qDebug("<ready-read>");
 
-    QVariantHash headers;
+    if (!greeted && socket.canReadLine()) {
+        qDebug() << "Asterisk Manager connected:" BOLD BLUE << socket.readLine().trimmed() << RESET;
+
+        greeted = true;
+
+        QVariantHash headers;
+        headers["Username"] = username;
+        headers["Secret"] = secret;
 
+        loginActionId = sendAction("Login", headers);
+    }
+
+    // A packet may span several reads, so the headers collected so far are kept in between
     while (socket.canReadLine()) {
         QByteArray line = socket.readLine();
 
 //        qDebug() << "Line:" << line;
 
         if (line != "\r\n") {
-            QStringList header = QString(line.trimmed()).split(':');
+            int separator = line.indexOf(':');
 
-            headers.insertMulti(header[0], decodeValue(header[1].trimmed()));
+            if (separator > 0)
+                packet.insertMulti(line.left(separator), decodeValue(QString(line.mid(separator + 1)).trimmed()));
         } else {
-            if (headers.contains("Response"))
-                responses.insert(headers.take("ActionID").toString(), headers);
-            else if (headers.contains("Event"))
-                emit eventReceived(headers.take("Event").toString(), headers);
-
-            headers.clear();
+            // Checked first, an OriginateResponse event carries a Response header of its own
+            if (packet.contains("Event")) {
+                // Counted before filtering, the rate reflects what Asterisk sends
+                Metrics::add(Metrics::AsteriskEvents);
+
+                if (packet.value("Event").toString() == "OriginateResponse" && asyncOriginates.remove(packet.value("ActionID").toString()))
+                    emit originateFinished(packet.value("ActionID").toString(), packet.value("Response").toString() == "Success",
+                                           packet.value("Reason").toString());
+
+                if (!ignoredEvents.contains(packet.value("Event").toString()))
+                    emit eventReceived(packet.take("Event").toString(), packet);
+            } else if (packet.contains("Response")) {
+                QString actionId = packet.take("ActionID").toString();
+
+                if (pendingActions.contains(actionId)) {
+                    QPair<QString, qint64> pending = pendingActions.take(actionId);
+
+                    Metrics::observe(Metrics::AsteriskActionDuration, Metrics::now() - pending.second, pending.first);
+                }
+
+                if (!loginActionId.isEmpty() && actionId == loginActionId) {
+                    loginActionId.clear();
+
+                    emit loginFinished(packet.value("Response").toString() == "Success", packet.value("Message").toString());
+                } else if (asyncOriginates.contains(actionId)) {
+                    // Only a rejected originate ends here, an accepted one still waits for its event
+                    if (packet.value("Response").toString() != "Success") {
+                        asyncOriginates.remove(actionId);
+
+                        emit originateFinished(actionId, false, packet.value("Message").toString());
+                    }
+                } else {
+                    responses.insert(actionId, packet);
+                }
+            }
+
+            packet.clear();
         }
     }
 
@@ -4,6 +4,7 @@
 #include <QObject>
 #include <QTcpSocket>
 #include <QStringList>
+#include <QSet>
 
 class Asterisk : public QObject
 {
@@ -13,11 +14,12 @@ public:
     explicit Asterisk(QObject *parent = 0, QString host = "localhost", quint16 port = 5038);
     ~Asterisk();
 
-    QVariantHash login(QString username, QString secret);
+    void login(QString username, QString secret);
     QVariantHash logout();
 
     QVariantHash coreShowChannels();
     QVariantHash sipPeers();
+    QVariantHash queueStatus(QString queue = QString());
 
     QVariantHash originate(QString channel,
                            QString exten = QString(),
@@ -33,6 +35,17 @@ public:
                            bool async = false,
                            QStringList codecs = QStringList());
 
+    // Returns the ActionID without waiting, the outcome arrives through originateFinished(), empty when not connected
+    QString originateAsync(QString channel,
+                           QString exten = QString(),
+                           QString context = QString(),
+                           uint priority = 0,
+                           QString application = QString(),
+                           QString data = QString(),
+                           uint timeout = 0,
+                           QString callerId = QString(),
+                           QVariantHash variables = QVariantHash());
+
     QVariantHash playDtmf(QString channel, QChar digit);
     QVariantHash hangup(QString channel, uint cause = 0);
 
@@ -45,16 +58,42 @@ public:
                           QString extraContext = QString(),
                           uint extraPriority = 0);
 
+    void setIgnoredEvents(QStringList events);
+
+    bool isConnected();
+    int getPendingActions();
+
 private:
     QTcpSocket socket;
     QString host, username, secret;
     quint16 port;
     QHash<QString, QVariantHash> responses;
+    QHash<QString, QPair<QString, qint64> > pendingActions; // key: ActionID, value: action and when it was sent
+    QSet<QString> asyncOriginates; // ActionIDs waiting for their OriginateResponse event
+    QVariantHash packet;
+    QString loginActionId;
+    bool greeted;
+    QSet<QString> ignoredEvents;
 
     void insertNotEmpty(QVariantHash *fields, QString key, QVariant value);
     QString encodeValue(QVariant value);
     QVariant decodeValue(QString string);
 
+    QVariantHash originateHeaders(QString channel,
+                                  QString exten,
+                                  QString context,
+                                  uint priority,
+                                  QString application,
+                                  QString data,
+                                  uint timeout,
+                                  QString callerId,
+                                  QVariantHash variables,
+                                  QString account,
+                                  bool earlyMedia,
+                                  bool async,
+                                  QStringList codecs);
+
+    QString sendAction(QString action, QVariantHash headers = QVariantHash());
     QVariantHash sendPacket(QString action, QVariantHash headers = QVariantHash());
 
 private slots:
@@ -64,6 +103,8 @@ private slots:
 
 signals:
     void eventReceived(QString event, QVariantHash headers);
+    void loginFinished(bool succeed, QString message);
+    void originateFinished(QString actionId, bool succeed, QString reason);
 };
 
 #endif // ASTERISK_H
@@ -0,0 +1,37 @@
+#include "bufferpool.h"
+
+BufferPool::BufferPool(int bufferSize, int capacity) :
+    bufferSize(bufferSize),
+    capacity(capacity)
+{
+    buffers.reserve(capacity);
+}
+
+QByteArray BufferPool::acquire()
+{
+    QMutexLocker locker(&mutex);
+
+    if (!buffers.isEmpty())
+        return buffers.takeLast();
+
+    locker.unlock();
+
+    QByteArray buffer;
+    buffer.reserve(bufferSize);
+
+    return buffer;
+}
+
+void BufferPool::release(QByteArray buffer)
+{
+    // Buffers grown by an unusually large message are not worth keeping around
+    if (buffer.capacity() > bufferSize * 4)
+        return;
+
+    buffer.resize(0);
+
+    QMutexLocker locker(&mutex);
+
+    if (buffers.count() < capacity)
+        buffers.append(buffer);
+}
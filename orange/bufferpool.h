@@ -0,0 +1,23 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QMutex>
+#include <QList>
+#include <QByteArray>
+
+// Recycles per-connection read buffers, acquired on accept and released by the Client on its worker thread
+class BufferPool
+{
+public:
+    explicit BufferPool(int bufferSize = 4096, int capacity = 4096);
+
+    QByteArray acquire();
+    void release(QByteArray buffer);
+
+private:
+    QMutex mutex;
+    QList<QByteArray> buffers;
+    int bufferSize, capacity;
+};
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,168 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QQueue>
+
+#include "wakeup.h"
+
+// Bounded ring of typed messages, any number of producers and a single consumer draining it in batches.
+// Each cell carries a sequence number telling whether it is free for the lap a producer or the consumer is on.
+// A full ring spills into a locked queue rather than making producers wait, two threads feeding each other's
+// channels would otherwise both spin on a full ring while neither drains its own.
+template <typename T>
+class Channel
+{
+public:
+    explicit Channel(Wakeup *wakeup, int capacity = 65536);
+    ~Channel();
+
+    bool tryPush(const T &message); // ring only, false when full
+    void push(const T &message);
+    bool pop(T *message);
+
+    // Approximate when called from any other thread than the consumer
+    int count();
+
+private:
+    struct Cell {
+        QAtomicInt sequence;
+        T message;
+    };
+
+    Wakeup *wakeup;
+    Cell *cells;
+    int mask;
+    QAtomicInt enqueuePosition;
+    QAtomicInt dequeuePosition; // written by the consumer only
+    QMutex overflowMutex;
+    QQueue<T> overflow;
+    QAtomicInt overflowCount;
+
+    bool take(T *message);
+
+    Q_DISABLE_COPY(Channel)
+};
+
+template <typename T>
+Channel<T>::Channel(Wakeup *wakeup, int capacity) :
+    wakeup(wakeup),
+    cells(NULL),
+    mask(1),
+    enqueuePosition(0),
+    dequeuePosition(0),
+    overflowCount(0)
+{
+    while (mask < capacity)
+        mask <<= 1;
+
+    cells = new Cell[mask];
+
+    for (int i = 0; i < mask; ++i)
+        cells[i].sequence.store(i);
+
+    mask--;
+}
+
+template <typename T>
+Channel<T>::~Channel()
+{
+    delete [] cells;
+}
+
+template <typename T>
+bool Channel<T>::tryPush(const T &message)
+{
+    int position = enqueuePosition.load();
+    Cell *cell;
+
+    forever {
+        cell = &cells[position & mask];
+
+        int difference = (int) ((uint) cell->sequence.loadAcquire() - (uint) position);
+
+        if (difference == 0) {
+            if (enqueuePosition.testAndSetRelaxed(position, (int) ((uint) position + 1)))
+                break;
+
+            position = enqueuePosition.load();
+        } else if (difference < 0) {
+            return false; // full, the consumer has not released this cell from the previous lap
+        } else {
+            position = enqueuePosition.load();
+        }
+    }
+
+    cell->message = message;
+    cell->sequence.storeRelease((int) ((uint) position + 1));
+
+    return true;
+}
+
+template <typename T>
+void Channel<T>::push(const T &message)
+{
+    // Once anything overflowed, later messages follow it there so that the order of each producer holds
+    if (overflowCount.loadAcquire() != 0 || !tryPush(message)) {
+        QMutexLocker locker(&overflowMutex);
+
+        overflow.enqueue(message);
+        overflowCount.fetchAndAddRelease(1);
+    }
+
+    wakeup->notify();
+}
+
+template <typename T>
+bool Channel<T>::pop(T *message)
+{
+    if (take(message))
+        return true;
+
+    if (overflowCount.loadAcquire() == 0)
+        return false;
+
+    QMutexLocker locker(&overflowMutex);
+
+    // A producer may have filled a cell just before overflowing, that message comes first
+    if (take(message))
+        return true;
+
+    // Cells claimed but not written yet are older still, their producer wakes us again once it is done
+    if (enqueuePosition.load() != dequeuePosition.load() || overflow.isEmpty())
+        return false;
+
+    *message = overflow.dequeue();
+    overflowCount.fetchAndAddRelease(-1);
+
+    return true;
+}
+
+template <typename T>
+bool Channel<T>::take(T *message)
+{
+    int position = dequeuePosition.load();
+    Cell *cell = &cells[position & mask];
+
+    int difference = (int) ((uint) cell->sequence.loadAcquire() - ((uint) position + 1));
+
+    if (difference < 0)
+        return false;
+
+    *message = cell->message;
+    cell->message = T(); // drops the references held by the cell
+
+    cell->sequence.storeRelease((int) ((uint) position + mask + 1));
+    dequeuePosition.store((int) ((uint) position + 1));
+
+    return true;
+}
+
+template <typename T>
+int Channel<T>::count()
+{
+    return qMax((int) ((uint) enqueuePosition.load() - (uint) dequeuePosition.load()), 0) + overflowCount.load();
+}
+
+#endif // CHANNEL_H
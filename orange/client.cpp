@@ -3,53 +3,126 @@
 #include <QSqlError>
 #include <QHostAddress>
 #include <QCryptographicHash>
+#include <QDataStream>
 #include <QDebug>
 
+#include <unistd.h>
+
 #include "common.h"
 #include "terminal.h"
+#include "metrics.h"
+#include "tracer.h"
 #include "client.h"
 
-Client::Client(QObject *parent) :
+Client::Delivery::Delivery() :
+    receiver(NULL),
+    username(0),
+    fullname(0),
+    group(0),
+    address(0),
+    extension(0),
+    queued(0),
+    trace(0)
+{
+}
+
+Client::Client(ConfigurationPointer configuration, BufferPool *bufferPool, QObject *parent) :
     QObject(parent),
-    settings(new QSettings(CONFIG_FILE, QSettings::IniFormat)),
+    configuration(configuration),
+    bufferPool(bufferPool),
     socket(NULL),
-    heartbeatTimerId(0),
+    socketIn(NULL),
+    fallbackIn(NULL),
+    actionElement(Parser::Unknown),
+    fallbackDepth(0),
+    readStarted(0),
+    fastParser(configuration->fastParser),
+    actionOpen(false),
+    authenticationOpen(false),
+    authenticationEncrypted(false),
+    xmlOut(NULL),
+    binaryFraming(false),
+    detachedDescriptor(-1),
+    heartbeatWheel(NULL),
+    stateFile(NULL),
+    events(NULL),
+    deliveries(NULL),
+    stateSlot(-1),
+    pendingEncrypted(false),
+    authenticationPending(false),
     agentId(0),
     agentExtenMapId(0),
     agentLogSessionId(0),
     agentLogStatusId(0),
+    trace(0),
+    usernameSymbol(0),
+    fullnameSymbol(0),
+    groupSymbol(0),
+    addressSymbol(0),
+    extensionSymbol(0),
     handle(0),
-    abandoned(0)
+    abandoned(0),
+    statistics(configuration->shiftHours)
 {
-    qRegisterMetaType<Client::Status>("Client::Status");
+    heartbeatEntry.client = this;
 
-    socketOut.setAutoFormatting(true);
-
-    statusText["ready"] = Ready;
-    statusText["not-ready"] = NotReady;
-    statusText["acw"] = ACW;
-    statusText["aux"] = AUX;
+    if (bufferPool != NULL)
+        parser.setBuffer(bufferPool->acquire());
 
-    statusText["free"] = Free;
-    statusText["initiate"] = Initiate;
-    statusText["originate"] = Originate;
-    statusText["ringing"] = Ringing;
-    statusText["busy"] = Busy;
-    statusText["release-callee"] = ReleaseCallee;
+    socketOut.setAutoFormatting(true);
 
     qDebug("Client initialized");
 }
 
 Client::~Client()
 {
-    settings->deleteLater();
+    if (heartbeatWheel != NULL)
+        heartbeatWheel->cancel(&heartbeatEntry);
+
+    if (bufferPool != NULL)
+        bufferPool->release(parser.takeBuffer());
+
+    if (detachedDescriptor >= 0)
+        ::close(detachedDescriptor);
+
+    delete socketIn;
+    delete fallbackIn;
+
+    if (!username.isEmpty())
+        Metrics::remove(Metrics::ClientOutputQueue, username);
 
     qDebug("Client destroyed");
 }
 
+static QHash<QString, Client::Status> createStatusTable()
+{
+    QHash<QString, Client::Status> statusText;
+    statusText["ready"] = Client::Ready;
+    statusText["not-ready"] = Client::NotReady;
+    statusText["acw"] = Client::ACW;
+    statusText["aux"] = Client::AUX;
+
+    statusText["free"] = Client::Free;
+    statusText["initiate"] = Client::Initiate;
+    statusText["originate"] = Client::Originate;
+    statusText["ringing"] = Client::Ringing;
+    statusText["busy"] = Client::Busy;
+    statusText["release-callee"] = Client::ReleaseCallee;
+
+    return statusText;
+}
+
+const QHash<QString, Client::Status> &Client::statusTable()
+{
+    // Shared by every connection, built once on first use
+    static const QHash<QString, Status> table = createStatusTable();
+
+    return table;
+}
+
 QString Client::getIpAddress()
 {
-    return socket->peerAddress().toString();
+    return address;
 }
 
 QString Client::getUsername()
@@ -62,21 +135,61 @@ QString Client::getFullname()
     return fullname;
 }
 
+int Client::getUsernameSymbol()
+{
+    return usernameSymbol;
+}
+
+int Client::getFullnameSymbol()
+{
+    return fullnameSymbol;
+}
+
+int Client::getGroupSymbol()
+{
+    return groupSymbol;
+}
+
+int Client::getAddressSymbol()
+{
+    return addressSymbol;
+}
+
+int Client::getExtensionSymbol()
+{
+    return extensionSymbol;
+}
+
 Client::Level Client::getLevel()
 {
     return level;
 }
 
+Client::Status Client::getStatus()
+{
+    return status;
+}
+
 Client::Phone Client::getPhone()
 {
     return phone;
 }
 
-QStringList Client::getGroups()
+const QStringList &Client::getGroups()
 {
     return groups;
 }
 
+const GroupSet &Client::getMemberships()
+{
+    return memberships;
+}
+
+QStringList Client::getSkills()
+{
+    return skills;
+}
+
 int Client::getHandle()
 {
     return handle;
@@ -99,21 +212,232 @@ void Client::setAbandoned(int abandoned)
         this->abandoned = abandoned;
 }
 
+Statistics *Client::getStatistics()
+{
+    return &statistics;
+}
+
 void Client::setSocket(QTcpSocket *socket)
 {
     this->socket = socket;
     this->socket->setParent(this);
 
-    socketIn.setDevice(socket);
+    // Formatted once, the peer address is gone from the socket as soon as it disconnects
+    address = socket->peerAddress().toString();
+    internSymbols();
+
+    if (!fastParser)
+        socketIn = new QXmlStreamReader(socket);
     socketOut.setDevice(socket);
 
+    connectSocket();
+    initiateHandshake();
+}
+
+void Client::resumeSession(QTcpSocket *socket, QByteArray session)
+{
+    this->socket = socket;
+    this->socket->setParent(this);
+
+    QDataStream stream(session);
+    QByteArray pending;
+    qint32 element, level, status;
+
+    stream >> username >> fullname >> extension >> groups >> skills >> level >> status;
+    stream >> phone.time >> phone.status >> phone.channel >> phone.active >> phone.outbound >> phone.dnis;
+    stream >> handle >> abandoned >> agentId >> agentExtenMapId >> agentLogSessionId >> agentLogStatusId >> loginTime;
+    stream >> binaryFraming >> element >> actionOpen >> authenticationOpen >> authenticationEncrypted >> authenticationText;
+    stream >> pending;
+
+    statistics.restore(stream);
+
+    this->level = (Level) level;
+    this->status = (Status) status;
+    actionElement = (Parser::Element) element;
+    memberships = GroupSet::fromNames(groups);
+    address = socket->peerAddress().toString();
+
+    internSymbols();
+
+    // The stream was opened by the previous process, both sides simply carry on inside it
+    fastParser = true;
+
+    if (binaryFraming) {
+        xmlOut = new QBuffer(this);
+        xmlOut->open(QIODevice::ReadWrite);
+        socketOut.setDevice(xmlOut);
+
+        frameIn = pending;
+    } else {
+        socketOut.setDevice(socket);
+
+        parser.append(pending);
+    }
+
+    connectSocket();
+
+    // Input already received by the previous process is replayed from the worker thread
+    QMetaObject::invokeMethod(this, "onSocketReadyRead", Qt::QueuedConnection);
+
+    qDebug() << "Client" BOLD BLUE << getIpAddress() << RESET "resumed, username:" BOLD BLUE << username << RESET;
+}
+
+int Client::takeDetachedDescriptor()
+{
+    int descriptor = detachedDescriptor;
+
+    detachedDescriptor = -1;
+
+    return descriptor;
+}
+
+QByteArray Client::detach()
+{
+    // Sessions are only cut between messages, anything else is left to reconnect normally
+    if (socket == NULL || socket->state() != QAbstractSocket::ConnectedState ||
+            (!fastParser && !binaryFraming) || fallbackDepth > 0 || authenticationPending)
+        return QByteArray();
+
+    if (socket->bytesToWrite() > 0 && !socket->waitForBytesWritten(1000))
+        return QByteArray();
+
+    QByteArray pending = binaryFraming ? frameIn : parser.pending(),
+               session;
+
+    pending.append(socket->readAll());
+
+    QDataStream stream(&session, QIODevice::WriteOnly);
+
+    stream << username << fullname << extension << groups << skills << (qint32) level << (qint32) status;
+    stream << phone.time << phone.status << phone.channel << phone.active << phone.outbound << phone.dnis;
+    stream << handle << abandoned << agentId << agentExtenMapId << agentLogSessionId << agentLogStatusId << loginTime;
+    stream << binaryFraming << (qint32) actionElement << actionOpen << authenticationOpen << authenticationEncrypted << authenticationText;
+    stream << pending;
+
+    statistics.save(stream);
+
+    detachedDescriptor = ::dup(socket->socketDescriptor());
+
+    if (detachedDescriptor < 0)
+        return QByteArray();
+
+    if (heartbeatWheel != NULL)
+        heartbeatWheel->cancel(&heartbeatEntry);
+
+    // Nothing must be logged out here, the connection lives on in the next process
+    socket->disconnect(this);
+    socket->abort();
+
+    qDebug() << "Client" BOLD BLUE << username << RESET "detached for handoff";
+
+    return session;
+}
+
+void Client::internSymbols()
+{
+    usernameSymbol = Symbols::intern(username);
+    fullnameSymbol = Symbols::intern(fullname);
+    groupSymbol = Symbols::intern(groups.isEmpty() ? QString() : groups.first());
+    addressSymbol = Symbols::intern(address);
+    extensionSymbol = Symbols::intern(extension);
+}
+
+void Client::connectSocket()
+{
     connect(socket, SIGNAL(disconnected()), SLOT(onSocketDisconnected()));
-    connect(socket, SIGNAL(disconnected()), SIGNAL(socketDisconnected()));
     connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), SLOT(onSocketError(QAbstractSocket::SocketError)));
     connect(socket, SIGNAL(readyRead()), SLOT(onSocketReadyRead()));
+}
 
-    initiateHandshake();
-    resetHeartbeatTimer();
+void Client::setHeartbeatWheel(TimingWheel *heartbeatWheel)
+{
+    this->heartbeatWheel = heartbeatWheel;
+}
+
+void Client::setStateFile(StateFile *stateFile)
+{
+    this->stateFile = stateFile;
+}
+
+void Client::setChannels(Channel<Client::Event> *events, Channel<Client::Delivery> *deliveries)
+{
+    this->events = events;
+    this->deliveries = deliveries;
+}
+
+void Client::deliver(Client::Delivery delivery)
+{
+    delivery.queued = Metrics::now();
+
+    if (deliveries != NULL)
+        deliveries->push(delivery);
+}
+
+void Client::handleDelivery(const Client::Delivery &delivery)
+{
+    Tracer::record(delivery.trace, "worker.delivery_queue", delivery.queued);
+    Tracer::Span span(delivery.trace, "client.handle_delivery");
+
+    // A status changed on behalf of a supervisor continues the supervisor's trace
+    trace = delivery.trace;
+
+    switch (delivery.type) {
+    case Delivery::AgentStatus:
+        sendAgentStatus(delivery.username, delivery.fullname, delivery.phone, delivery.handle, delivery.abandoned,
+                        delivery.group, delivery.login, delivery.address, delivery.extension);
+
+        break;
+    case Delivery::AgentLogout:
+        sendAgentLogout(delivery.username, delivery.extension, delivery.group, delivery.address);
+
+        break;
+    case Delivery::QueueStatus:
+        sendQueueStatus(delivery.snapshot);
+
+        break;
+    case Delivery::ChangeStatus:
+        changeStatus(delivery.status);
+        changePhoneStatus(delivery.status == Ready ? "ready" : "aux", delivery.outbound);
+
+        break;
+    case Delivery::Release:
+        break;
+    }
+
+    if (delivery.group != 0)
+        Metrics::observe(Metrics::DeliveryLatency, Metrics::now() - delivery.queued, Symbols::text(delivery.group));
+
+    if (socket != NULL && !username.isEmpty())
+        Metrics::set(Metrics::ClientOutputQueue, socket->bytesToWrite(), username);
+
+    trace = 0;
+}
+
+void Client::post(Client::Event::Type type, Client::Status status, bool outbound, int extension, const QStringList &arguments)
+{
+    if (events == NULL)
+        return;
+
+    Event event;
+    event.type = type;
+    event.client = this;
+    event.status = status;
+    event.outbound = outbound;
+    event.extension = extension;
+    event.arguments = arguments;
+    event.trace = trace;
+    event.posted = trace != 0 ? Metrics::now() : 0;
+
+    events->push(event);
+
+    // Service releases the client on its disconnection, nothing may reach it after that one
+    if (type == Event::Disconnected)
+        events = NULL;
+}
+
+void Client::post(Client::Event::Type type, const QStringList &arguments)
+{
+    post(type, Login, false, 0, arguments);
 }
 
 QString Client::getExtension()
@@ -125,7 +449,10 @@ void Client::setExtension(QString extension)
 {
     this->extension = extension;
 
-    emit userExtensionChanged(extension);
+    internSymbols();
+    updateStateRecord();
+
+    post(Event::ExtensionChanged, Login, false, extensionSymbol);
 }
 
 void Client::forceLogout(QString status)
@@ -133,22 +460,37 @@ void Client::forceLogout(QString status)
     if (agentId <= 0)
         return;
 
-    socketOut.writeStartElement("authentication");
-    socketOut.writeAttribute("id", "force-logout");
-    socketOut.writeTextElement("status", status);
-    socketOut.writeEndElement();
+    if (binaryFraming) {
+        QByteArray body;
+        Framing::appendField(&body, Framing::Message, status);
+
+        socket->write(Framing::encode(Framing::Logout, body));
+    } else {
+        socketOut.writeStartElement("authentication");
+        socketOut.writeAttribute("id", "force-logout");
+        socketOut.writeTextElement("status", status);
+        socketOut.writeEndElement();
+
+        endMessage();
+    }
 
-    socket->write("\n");
     socket->flush();
     socket->disconnectFromHost();
 }
 
 void Client::changeStatus(Client::Status status)
 {
+    Tracer::Span span(trace, "client.change_status");
+
     endStatus();
     startStatus(status);
 
-    emit userStatusChanged(status);
+    statistics.transition(status);
+
+    handle = statistics.totalHandled();
+    abandoned = statistics.totalAbandoned();
+
+    post(Event::StatusChanged, status);
 }
 
 void Client::changePhoneStatus(QString status, bool outbound)
@@ -157,24 +499,53 @@ void Client::changePhoneStatus(QString status, bool outbound)
     phone.status = status;
     phone.outbound = outbound;
 
-    sendAgentStatus(username, fullname, phone, handle, abandoned);
+    sendAgentStatus(usernameSymbol, fullnameSymbol, phone, handle, abandoned);
 
-    emit phoneStatusChanged(status);
+    post(Event::PhoneStatusChanged);
 
     qDebug() << "Phone status of" BOLD BLUE << username << RESET "changed to:" BOLD BLUE << status << RESET;
 }
 
-void Client::sendAgentStatus(QString username, QString fullname, Client::Phone phone, int handle, int abandoned, QString group, QDateTime login, QString address, QString extension)
+void Client::sendAgentStatus(int username, int fullname, Client::Phone phone, int handle, int abandoned, int group, QDateTime login, int address, int extension)
 {
-    bool groupEmpty = group.isEmpty();
+    Tracer::Span span(trace, "client.write_agent_status");
+
+    if (binaryFraming) {
+        QByteArray body;
+        body.reserve(160);
+
+        Framing::appendField(&body, Framing::Username, Symbols::utf8(username));
+        Framing::appendField(&body, Framing::Fullname, Symbols::utf8(fullname));
+        Framing::appendField(&body, Framing::Group, Symbols::utf8(group));
+        Framing::appendField(&body, Framing::Handle, QString::number(handle));
+        Framing::appendField(&body, Framing::Abandoned, QString::number(abandoned));
+
+        if (login.isValid())
+            Framing::appendField(&body, Framing::Login, login.toString("yyyy-MM-dd HH:mm:ss"));
+
+        Framing::appendField(&body, Framing::Time, phone.time.toString("yyyy-MM-dd HH:mm:ss"));
+        Framing::appendField(&body, Framing::Address, Symbols::utf8(address));
+        Framing::appendField(&body, Framing::Extension, Symbols::utf8(extension));
+        Framing::appendField(&body, Framing::PhoneStatus, phone.status);
+        Framing::appendField(&body, Framing::Outbound, phone.outbound ? "true" : "false");
+        Framing::appendField(&body, phone.active ? Framing::ActiveChannel : Framing::PassiveChannel, phone.channel);
+        Framing::appendField(&body, phone.active ? Framing::Callee : Framing::Caller, phone.dnis);
+
+        socket->write(Framing::encode(Framing::AgentStatus, body));
+
+        return;
+    }
+
+    bool groupEmpty = group == 0;
+    QString groupText = Symbols::text(group);
 
     socketOut.writeStartElement("agent");
 
-    socketOut.writeTextElement("username", username);
-    socketOut.writeTextElement("fullname", fullname);
+    socketOut.writeTextElement("username", Symbols::text(username));
+    socketOut.writeTextElement("fullname", Symbols::text(fullname));
 
     if (!groupEmpty)
-        socketOut.writeTextElement("group", group);
+        socketOut.writeTextElement("group", groupText);
 
     socketOut.writeTextElement("handle", QString::number(handle));
     socketOut.writeTextElement("abandoned", QString::number(abandoned));
@@ -184,18 +555,18 @@ void Client::sendAgentStatus(QString username, QString fullname, Client::Phone p
 
     socketOut.writeTextElement("time", phone.time.toString("yyyy-MM-dd HH:mm:ss"));
 
-    if (!address.isEmpty())
-        socketOut.writeTextElement("address", address);
+    if (address != 0)
+        socketOut.writeTextElement("address", Symbols::text(address));
 
-    if (!extension.isEmpty())
-        socketOut.writeTextElement("extension", extension);
+    if (extension != 0)
+        socketOut.writeTextElement("extension", Symbols::text(extension));
 
     socketOut.writeStartElement("phone");
     socketOut.writeAttribute("status", phone.status);
     socketOut.writeAttribute("outbound", phone.outbound ? "true" : "false");
 
     if (!groupEmpty)
-        socketOut.writeAttribute("group", group);
+        socketOut.writeAttribute("group", groupText);
 
     if (!phone.channel.isEmpty()) {
         socketOut.writeAttribute(phone.active ? "activechannel" : "passivechannel", phone.channel);
@@ -210,37 +581,134 @@ void Client::sendAgentStatus(QString username, QString fullname, Client::Phone p
 
     socketOut.writeEndElement(); // agent
 
-    socket->write("\n");
+    endMessage();
 }
 
-void Client::sendAgentLogout(QString username, QString extension, QString group, QString address)
+void Client::sendAgentLogout(int username, int extension, int group, int address)
 {
+    if (binaryFraming) {
+        QByteArray body;
+
+        Framing::appendField(&body, Framing::Username, Symbols::utf8(username));
+        Framing::appendField(&body, Framing::Extension, Symbols::utf8(extension));
+        Framing::appendField(&body, Framing::Group, Symbols::utf8(group));
+        Framing::appendField(&body, Framing::Address, Symbols::utf8(address));
+
+        socket->write(Framing::encode(Framing::AgentLogout, body));
+
+        return;
+    }
+
     socketOut.writeStartElement("agent");
-    socketOut.writeTextElement("username", username);
-    socketOut.writeTextElement("extension", extension);
-    socketOut.writeTextElement("group", group);
-    socketOut.writeTextElement("address", address);
+    socketOut.writeTextElement("username", Symbols::text(username));
+    socketOut.writeTextElement("extension", Symbols::text(extension));
+    socketOut.writeTextElement("group", Symbols::text(group));
+    socketOut.writeTextElement("address", Symbols::text(address));
     socketOut.writeEmptyElement("logout");
-    socketOut.writeEndElement(); // logout
     socketOut.writeEndElement(); // agent
+
+    endMessage();
 }
 
-void Client::sendDialerResponse(QString formattedNumber)
+void Client::sendDialerResponse(QString destination, QString formattedNumber, QString status, QString trunk)
 {
     socketOut.writeStartElement("dialer");
+    socketOut.writeAttribute("destination", destination);
     socketOut.writeAttribute("formatted-number", formattedNumber);
+    socketOut.writeAttribute("status", status);
+
+    if (!trunk.isEmpty())
+        socketOut.writeAttribute("trunk", trunk);
+
     socketOut.writeEndElement();
 
-    socket->write("\n");
+    endMessage();
 }
 
-void Client::timerEvent(QTimerEvent *event)
+void Client::sendSpyResponse(QString agentUsername, QString mode, bool succeed, QString message)
 {
-    socket->write("-ERR Timeout\n");
+    socketOut.writeStartElement("spy");
+    socketOut.writeAttribute("agent", agentUsername);
+    socketOut.writeAttribute("mode", mode);
+    socketOut.writeAttribute("status", succeed ? "ok" : "failed");
+
+    if (!message.isEmpty())
+        socketOut.writeAttribute("message", message);
+
+    socketOut.writeEndElement();
+
+    endMessage();
+}
+
+void Client::sendStatistics(QString group, QString window, Statistics::Report report)
+{
+    Statistics::Counters total;
+
+    socketOut.writeStartElement("statistics");
+    socketOut.writeAttribute("group", group);
+    socketOut.writeAttribute("window", window);
+
+    foreach (const Statistics::Entry &entry, report) {
+        socketOut.writeStartElement("agent");
+        socketOut.writeAttribute("username", entry.username);
+        socketOut.writeAttribute("handled", QString::number(entry.counters.handled));
+        socketOut.writeAttribute("abandoned", QString::number(entry.counters.abandoned));
+        socketOut.writeAttribute("aht", QString::number(entry.counters.averageHandleTime() / 1000));
+
+        for (int i = Login; i < Statistics::StatusCount; ++i) {
+            if (entry.counters.duration[i] <= 0)
+                continue;
+
+            socketOut.writeEmptyElement("time");
+            socketOut.writeAttribute("status", QString::number(i));
+            socketOut.writeAttribute("seconds", QString::number(entry.counters.duration[i] / 1000));
+        }
+
+        socketOut.writeEndElement(); // agent
+
+        total.add(entry.counters);
+    }
+
+    socketOut.writeEmptyElement("total");
+    socketOut.writeAttribute("handled", QString::number(total.handled));
+    socketOut.writeAttribute("abandoned", QString::number(total.abandoned));
+    socketOut.writeAttribute("aht", QString::number(total.averageHandleTime() / 1000));
+
+    socketOut.writeEndElement(); // statistics
+
+    endMessage();
+}
+
+void Client::sendQueueStatus(Queue::Snapshot snapshot)
+{
+    socketOut.writeStartElement("queue");
+    socketOut.writeAttribute("name", snapshot.name);
+    socketOut.writeAttribute("waiting", QString::number(snapshot.waiting));
+    socketOut.writeAttribute("longest-wait", QString::number(snapshot.longestWait));
+    socketOut.writeAttribute("completed", QString::number(snapshot.completed));
+    socketOut.writeAttribute("abandoned", QString::number(snapshot.abandoned));
+    socketOut.writeAttribute("service-level", QString::number(snapshot.serviceLevel));
+    socketOut.writeAttribute("available", QString::number(snapshot.available));
+    socketOut.writeAttribute("busy", QString::number(snapshot.busy));
+    socketOut.writeAttribute("paused", QString::number(snapshot.paused));
+    socketOut.writeEndElement();
+
+    endMessage();
+}
+
+void Client::heartbeatExpired()
+{
+    if (binaryFraming) {
+        QByteArray body;
+        Framing::appendField(&body, Framing::Message, "timeout");
+
+        socket->write(Framing::encode(Framing::Logout, body));
+    } else {
+        socket->write("-ERR Timeout\n");
+    }
+
     socket->flush();
     socket->disconnectFromHost();
-
-    Q_UNUSED(event)
 }
 
 void Client::logFailedQuery(QSqlQuery *query, QString queryTitle)
@@ -265,7 +733,7 @@ QVariant Client::getLastInsertId(QString table, QString column)
 
 void Client::initiateHandshake()
 {
-    if (settings->value("orange/single_quote_handshake", false).toBool())
+    if (configuration->singleQuoteHandshake)
         socket->write("<?xml version='1.0' encoding='UTF-8'?>");
     else
         socketOut.writeStartDocument();
@@ -275,6 +743,18 @@ void Client::initiateHandshake()
     socketOut.writeStartElement("welcome");
     socketOut.writeAttribute("name", "CTI Server v1.0");
     socketOut.writeTextElement("note", "Send <quit /> to close connection");
+
+    if (fastParser) {
+        socketOut.writeStartElement("framing");
+        socketOut.writeEmptyElement("type");
+        socketOut.writeAttribute("id", "xml");
+        socketOut.writeEmptyElement("type");
+        socketOut.writeAttribute("id", "binary");
+        socketOut.writeAttribute("version", "1");
+        socketOut.writeTextElement("note", "send <framing type=\"binary\" /> to switch to length prefixed frames");
+        socketOut.writeEndElement(); // framing
+    }
+
     socketOut.writeEndElement();
 
     socketOut.writeStartElement("authentication");
@@ -292,7 +772,7 @@ void Client::initiateHandshake()
 
     socketOut.writeEndElement();
 
-    socket->write("\n");
+    endMessage();
 }
 
 void Client::retrieveExtension()
@@ -302,9 +782,9 @@ void Client::retrieveExtension()
                               "FROM acd_agent_exten_map "
                               "WHERE ip_address = :ip_address");
 
-    retrieveExtension.bindValue(":ip_address", socket->peerAddress().toString());
+    retrieveExtension.bindValue(":ip_address", address);
 
-    if (retrieveExtension.exec()) {
+    if (Metrics::exec(&retrieveExtension, "retrieve_extension")) {
         if (retrieveExtension.next()) {
             agentExtenMapId = retrieveExtension.value(0).toUInt();
 
@@ -328,10 +808,14 @@ void Client::retrieveSkills()
 
     retrieveSkills.bindValue(":agent_id", agentId);
 
-    if (retrieveSkills.exec()) {
+    if (Metrics::exec(&retrieveSkills, "retrieve_skills")) {
+        skills.clear();
+
         socketOut.writeStartElement("transfer");
 
         while (retrieveSkills.next()) {
+            skills << retrieveSkills.value(0).toString();
+
             socketOut.writeEmptyElement("skill");
             socketOut.writeAttribute("name", retrieveSkills.value(0).toString());
             socketOut.writeAttribute("id", retrieveSkills.value(1).toString());
@@ -353,12 +837,16 @@ void Client::retrieveGroups()
 
     retrieveGroups.bindValue(":agent_id", agentId);
 
-    if (retrieveGroups.exec()) {
+    if (Metrics::exec(&retrieveGroups, "retrieve_groups")) {
         groups.clear();
 
         while (retrieveGroups.next()) {
             groups << retrieveGroups.value(0).toString();
         }
+
+        memberships = GroupSet::fromNames(groups);
+
+        internSymbols();
     } else {
         logFailedQuery(&retrieveGroups, "retrieving user's groups");
     }
@@ -374,13 +862,27 @@ void Client::startSession()
     insertSession.bindValue(":agent_exten_map_id", agentExtenMapId <= 0 ? QVariant() : agentExtenMapId);
     insertSession.bindValue(":login_time", QDateTime::currentDateTime());
 
-    if (insertSession.exec())
+    if (Metrics::exec(&insertSession, "insert_session"))
         agentLogSessionId = getLastInsertId("acd_log_agent_session", "acd_log_agent_session_id").toULongLong();
     else
         logFailedQuery(&insertSession, "inserting session log");
+
+    loginTime = QDateTime::currentDateTime();
 }
 
-void Client::endSession()
+void Client::continueSession(const StateFile::Record &record)
+{
+    agentLogSessionId = record.agentLogSessionId;
+    agentLogStatusId = record.agentLogStatusId;
+    loginTime = QDateTime::fromMSecsSinceEpoch(record.login);
+
+    // The status open at the time of the crash ends when the previous process was last seen alive
+    endStatus(QDateTime::fromMSecsSinceEpoch(record.lastAlive));
+
+    qDebug() << "Session of" BOLD BLUE << username << RESET "resumed:" BOLD BLUE << agentLogSessionId << RESET;
+}
+
+void Client::endSession(QDateTime logoutTime)
 {
     if (agentLogSessionId <= 0)
         return;
@@ -390,17 +892,25 @@ void Client::endSession()
                           "SET logout_time = :logout_time "
                           "WHERE acd_log_agent_session_id = :agent_log_session_id");
 
-    updateSession.bindValue(":logout_time", QDateTime::currentDateTime());
+    updateSession.bindValue(":logout_time", logoutTime);
     updateSession.bindValue(":agent_log_session_id", agentLogSessionId);
 
-    if (updateSession.exec())
+    if (Metrics::exec(&updateSession, "update_session"))
         agentLogSessionId = 0;
     else
         logFailedQuery(&updateSession, "updating session log");
+
+    if (stateFile != NULL && stateSlot >= 0) {
+        stateFile->release(stateSlot);
+
+        stateSlot = -1;
+    }
 }
 
 void Client::startStatus(Status status)
 {
+    Tracer::Span span(trace, "client.start_status");
+
     this->status = status;
 
     QSqlQuery insertStatus;
@@ -411,13 +921,15 @@ void Client::startStatus(Status status)
     insertStatus.bindValue(":status", (quint16) status);
     insertStatus.bindValue(":start", QDateTime::currentDateTime());
 
-    if (insertStatus.exec())
+    if (Metrics::exec(&insertStatus, "insert_status"))
         agentLogStatusId = getLastInsertId("acd_log_agent_status", "acd_log_agent_status_id").toULongLong();
     else
         logFailedQuery(&insertStatus, "inserting status log");
+
+    updateStateRecord();
 }
 
-void Client::endStatus()
+void Client::endStatus(QDateTime finish)
 {
     if (agentLogStatusId <= 0)
         return;
@@ -427,10 +939,10 @@ void Client::endStatus()
                          "SET finish = :finish "
                          "WHERE acd_log_agent_status_id = :agent_log_status_id");
 
-    updateStatus.bindValue(":finish", QDateTime::currentDateTime());
+    updateStatus.bindValue(":finish", finish);
     updateStatus.bindValue(":agent_log_status_id", agentLogStatusId);
 
-    if (updateStatus.exec())
+    if (Metrics::exec(&updateStatus, "update_status"))
         agentLogStatusId = 0;
     else
         logFailedQuery(&updateStatus, "updating status log");
@@ -444,12 +956,61 @@ void Client::endLogging()
     endSession();
 }
 
+void Client::updateStateRecord()
+{
+    if (stateFile == NULL || agentId <= 0 || agentLogSessionId <= 0)
+        return;
+
+    if (stateSlot < 0 && (stateSlot = stateFile->allocate()) < 0)
+        return;
+
+    StateFile::Record record;
+    record.sequence = 0;
+    record.agentId = agentId;
+    record.agentExtenMapId = agentExtenMapId;
+    record.status = status;
+    record.agentLogSessionId = agentLogSessionId;
+    record.agentLogStatusId = agentLogStatusId;
+    record.login = loginTime.toMSecsSinceEpoch();
+    record.lastAlive = 0;
+
+    StateFile::copyText(record.username, sizeof(record.username), username);
+    StateFile::copyText(record.extension, sizeof(record.extension), extension);
+    StateFile::copyText(record.groups, sizeof(record.groups), groups.join(","));
+    StateFile::copyText(record.channel, sizeof(record.channel), phone.channel);
+
+    stateFile->write(stateSlot, record);
+}
+
+void Client::adoptStateSlot(int slot)
+{
+    // The record the previous process left in it is overwritten right away
+    if (stateSlot < 0)
+        stateSlot = slot;
+    else
+        stateFile->release(slot);
+
+    updateStateRecord();
+}
+
 void Client::resetHeartbeatTimer()
 {
-    if (heartbeatTimerId > 0)
-        killTimer(heartbeatTimerId);
+    if (heartbeatWheel != NULL && socket->state() == QAbstractSocket::ConnectedState)
+        heartbeatWheel->schedule(&heartbeatEntry);
+}
+
+void Client::requestAuthentication(QString authentication, bool encrypted)
+{
+    if (authenticationPending || agentId > 0)
+        return;
+
+    authenticationPending = true;
+    pendingAuthentication = authentication;
+    pendingEncrypted = encrypted;
 
-    heartbeatTimerId = startTimer(20000);
+    QString credentials = encrypted ? QString(QByteArray::fromBase64(authentication.toLatin1())) : authentication;
+
+    post(Event::AskAuthentication, QStringList() << credentials.section(':', 0, 0));
 }
 
 void Client::checkAuthentication(QString authentication, bool encrypted)
@@ -461,6 +1022,10 @@ void Client::checkAuthentication(QString authentication, bool encrypted)
         authentication = QByteArray::fromBase64(authentication.toLatin1());
 
     QStringList usernamePassword = QString(authentication).split(":");
+
+    if (usernamePassword.count() < 2)
+        usernamePassword << QString();
+
     QString hashedPassword = QCryptographicHash::hash(usernamePassword[1].toLatin1(), QCryptographicHash::Md5).toHex();
 
     socketOut.writeStartElement("authentication");
@@ -474,7 +1039,7 @@ void Client::checkAuthentication(QString authentication, bool encrypted)
     retrieveUser.bindValue(":username", usernamePassword[0]);
     retrieveUser.bindValue(":password", hashedPassword);
 
-    if (retrieveUser.exec()) {
+    if (Metrics::exec(&retrieveUser, "retrieve_user")) {
         if (retrieveUser.next()) {
             username = usernamePassword[0];
             fullname = retrieveUser.value(3).toString();
@@ -482,6 +1047,8 @@ void Client::checkAuthentication(QString authentication, bool encrypted)
             agentId = retrieveUser.value(0).toUInt();
             status = "ok";
 
+            internSymbols();
+
             socketOut.writeTextElement("level", QString::number(level));
             socketOut.writeTextElement("login", QDateTime::currentDateTime().toString("yyyy-MM-dd HH:mm:ss"));
 
@@ -492,10 +1059,22 @@ void Client::checkAuthentication(QString authentication, bool encrypted)
 
             retrieveSkills();
             retrieveGroups();
-            startSession();
+
+            StateFile::Record record;
+            int slot;
+
+            // A session left open by a crashed process is carried on rather than duplicated, in the slot it was kept in
+            if (stateFile != NULL && stateFile->takeRecovered(username, agentId, &record, &slot)) {
+                stateSlot = slot;
+
+                continueSession(record);
+            } else {
+                startSession();
+            }
+
             startStatus(Login);
 
-            emit userLoggedIn();
+            post(Event::LoggedIn);
         } else {
             message = "Username/Password incorrect";
         }
@@ -512,44 +1091,279 @@ void Client::checkAuthentication(QString authentication, bool encrypted)
 
     socketOut.writeEndElement(); // authentication
 
-    socket->write("\n");
+    endMessage();
+
+    post(Event::AuthenticationFinished);
+}
+
+void Client::authenticate()
+{
+    if (!authenticationPending)
+        return;
+
+    authenticationPending = false;
+
+    checkAuthentication(pendingAuthentication, pendingEncrypted);
+
+    pendingAuthentication.clear();
+}
+
+void Client::sendAuthenticationQueued(int position)
+{
+    if (!authenticationPending)
+        return;
+
+    socketOut.writeStartElement("authentication");
+    socketOut.writeAttribute("id", "status");
+    socketOut.writeTextElement("status", "queued");
+    socketOut.writeTextElement("position", QString::number(position));
+    socketOut.writeEndElement(); // authentication
+
+    endMessage();
+}
+
+void Client::sendAuthenticationRejected(QString message)
+{
+    if (!authenticationPending)
+        return;
+
+    authenticationPending = false;
+    pendingAuthentication.clear();
+
+    socketOut.writeStartElement("authentication");
+    socketOut.writeAttribute("id", "status");
+    socketOut.writeTextElement("status", "failed");
+    socketOut.writeTextElement("message", message);
+    socketOut.writeEndElement(); // authentication
+
+    endMessage();
 }
 
-void Client::dispatchAction(QString actionType, QXmlStreamAttributes attributes)
+void Client::dispatchAction(Parser::Element action, QXmlStreamAttributes attributes)
 {
-    if (actionType == "ready") {
+    switch (action) {
+    case Parser::Ready: {
         bool outbound = attributes.value("outbound").toString() == "true",
              ready = attributes.value("value").toString() == "true";
 
         QString status = ready ? "ready" : attributes.value("mode").toString();
 
-        changeStatus(statusText.value(status));
+        trace = Tracer::begin();
+        Tracer::record(trace, "client.parse", readStarted);
+
+        changeStatus(statusTable().value(status));
         changePhoneStatus(status, outbound);
-    } else if (actionType == "ask-dial-authorization") {
+
+        trace = 0;
+
+        break;
+    }
+    case Parser::AskDialAuthorization: {
         QString customerId = attributes.value("customerid").toString(),
                 destination = attributes.value("destination").toString(),
                 campaign = attributes.value("campaign").toString();
 
-        emit askDialAuthorization(destination, customerId, campaign);
-    } else if (actionType == "spy") {
-        QString agent = attributes.value("agent").toString();
+        post(Event::AskDialAuthorization, QStringList() << destination << customerId << campaign);
 
-        emit spyAgentPhone(agent);
-    } else if (actionType == "status") {
+        break;
+    }
+    case Parser::Spy: {
+        QString agent = attributes.value("agent").toString(),
+                mode = attributes.value("mode").toString();
+
+        post(Event::SpyAgentPhone, QStringList() << agent << (mode.isEmpty() ? "spy" : mode));
+
+        break;
+    }
+    case Parser::Status: {
         bool outbound = attributes.value("outbound").toString() == "true",
              ready = attributes.value("ready").toString() == "true";
 
         QString group = attributes.value("group").toString(),
                 extension = attributes.value("extension").toString();
 
-        emit changeAgentStatus(ready ? Ready : NotReady, outbound, extension);
+        trace = Tracer::begin();
+        Tracer::record(trace, "client.parse", readStarted);
+
+        post(Event::ChangeAgentStatus, ready ? Ready : NotReady, outbound, Symbols::find(extension));
+
+        trace = 0;
 
         Q_UNUSED(group)
+
+        break;
+    }
+    case Parser::Statistics: {
+        QString group = attributes.value("group").toString(),
+                window = attributes.value("window").toString();
+
+        post(Event::AskStatistics, QStringList() << group << window);
+
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void Client::readStream(QXmlStreamReader *reader)
+{
+    while (!reader->atEnd()) {
+        QXmlStreamReader::TokenType tokenType = reader->readNext();
+
+        switch (tokenType) {
+        case QXmlStreamReader::StartDocument:
+            break;
+        case QXmlStreamReader::StartElement: {
+            QString elementName = reader->name().toString();
+            QXmlStreamAttributes attributes = reader->attributes();
+
+            if (elementName == "beat") {
+                reader->readElementText();
+
+                resetHeartbeatTimer();
+            } else if (elementName == "authentication") {
+                QString authentication = reader->readElementText();
+                bool encrypted = attributes.value("type").toString() == "encrypted";
+
+                requestAuthentication(authentication, encrypted);
+            } else if (elementName == "action") {
+                QByteArray actionType = attributes.value("type").toString().toLatin1();
+
+                if (reader->readNextStartElement()) {
+                    if (reader->name().toString() == actionType)
+                        dispatchAction(Parser::lookup(actionType.constData(), actionType.size()), reader->attributes());
+                }
+            }
+
+            break;
+        }
+        case QXmlStreamReader::EndElement:
+            if (reader->name() == "stream")
+                socket->disconnectFromHost();
+
+            break;
+        case QXmlStreamReader::Invalid:
+//            qDebug() << reader->errorString();
+            break;
+        default:
+//            qDebug() << "Token:" << tokenType;
+            break;
+        }
+    }
+}
+
+void Client::feedFallback(const QByteArray &data)
+{
+    // Elements outside the fast parser vocabulary are replayed into this reader, inside an implicit stream
+    if (fallbackIn == NULL) {
+        fallbackIn = new QXmlStreamReader;
+        fallbackIn->addData("<stream>");
+    }
+
+    fallbackIn->addData(data);
+}
+
+void Client::handleToken(const Parser::Token &token)
+{
+    // An element outside the vocabulary is handed to the generic reader together with its whole subtree
+    if (fallbackDepth > 0 || (token.type == Parser::StartElement && token.element == Parser::Unknown && !actionOpen)) {
+        feedFallback(parser.raw(token));
+
+        if (token.type == Parser::StartElement && !token.selfClosing)
+            fallbackDepth++;
+        else if (token.type == Parser::EndElement)
+            fallbackDepth--;
+
+        if (fallbackDepth <= 0) {
+            fallbackDepth = 0;
+
+            readStream(fallbackIn);
+        }
+
+        return;
+    }
+
+    switch (token.type) {
+    case Parser::StartElement:
+        switch (token.element) {
+        case Parser::Beat:
+            resetHeartbeatTimer();
+
+            break;
+        case Parser::Authentication:
+            authenticationEncrypted = Parser::attribute(token, "type") == "encrypted";
+            authenticationText.clear();
+            authenticationOpen = !token.selfClosing;
+
+            if (token.selfClosing)
+                requestAuthentication(QString(), authenticationEncrypted);
+
+            break;
+        case Parser::Action: {
+            Parser::Slice actionType = Parser::attribute(token, "type");
+
+            actionElement = Parser::lookup(actionType.data, actionType.length);
+            actionOpen = !token.selfClosing;
+
+            break;
+        }
+        case Parser::Framing:
+            if (Parser::attribute(token, "type") == "binary")
+                switchToBinaryFraming();
+
+            break;
+        case Parser::Ready:
+        case Parser::AskDialAuthorization:
+        case Parser::Spy:
+        case Parser::Status:
+        case Parser::Statistics:
+            if (actionOpen && token.element == actionElement)
+                dispatchAction(token.element, Parser::attributes(token));
+
+            break;
+        default:
+            break;
+        }
+
+        break;
+    case Parser::EndElement:
+        switch (token.element) {
+        case Parser::Authentication:
+            if (authenticationOpen) {
+                authenticationOpen = false;
+
+                requestAuthentication(authenticationText, authenticationEncrypted);
+            }
+
+            break;
+        case Parser::Action:
+            actionOpen = false;
+            actionElement = Parser::Unknown;
+
+            break;
+        case Parser::Stream:
+            socket->disconnectFromHost();
+
+            break;
+        default:
+            break;
+        }
+
+        break;
+    case Parser::Characters:
+        if (authenticationOpen)
+            authenticationText += Parser::decode(token.text);
+
+        break;
     }
 }
 
 void Client::onSocketDisconnected()
 {
+    if (heartbeatWheel != NULL)
+        heartbeatWheel->cancel(&heartbeatEntry);
+
     disconnect(socket);
 
     socket->deleteLater();
@@ -557,9 +1371,12 @@ void Client::onSocketDisconnected()
     if (!username.isEmpty()) {
         endLogging();
 
-        emit userLoggedOut();
+        post(Event::LoggedOut);
     }
 
+    // Last message of this client, Service answers it with a Release delivery once nothing refers to it anymore
+    post(Event::Disconnected);
+
     qDebug("Client disconnected");
 }
 
@@ -571,49 +1388,162 @@ void Client::onSocketError(QAbstractSocket::SocketError socketError)
     qWarning() << "Client connection error:" BOLD CYAN << socketErrorKey << RESET;
 }
 
-void Client::onSocketReadyRead()
+void Client::endMessage()
 {
-    while (!socketIn.atEnd()) {
-        QXmlStreamReader::TokenType tokenType = socketIn.readNext();
+    if (!binaryFraming) {
+        socket->write("\n");
 
-        switch (tokenType) {
-        case QXmlStreamReader::StartDocument:
-            break;
-        case QXmlStreamReader::StartElement: {
-            QString elementName = socketIn.name().toString();
-            QXmlStreamAttributes attributes = socketIn.attributes();
+        return;
+    }
 
-            if (elementName == "beat") {
-                socketIn.readElementText();
+    // Messages without a binary form travel as XML fragments, split to fit the frame length
+    QByteArray &xml = xmlOut->buffer();
 
-                resetHeartbeatTimer();
-            } else if (elementName == "authentication") {
-                QString authentication = socketIn.readElementText();
-                bool encrypted = attributes.value("type").toString() == "encrypted";
+    for (int i = 0; i < xml.size(); i += Framing::MaxBodyLength)
+        socket->write(Framing::encode(Framing::Xml, xml.mid(i, Framing::MaxBodyLength)));
 
-                checkAuthentication(authentication, encrypted);
-            } else if (elementName == "action") {
-                QString actionType = attributes.value("type").toString();
+    xml.resize(0);
+    xmlOut->seek(0);
+}
 
-                if (socketIn.readNextStartElement()) {
-                    if (socketIn.name().toString() == actionType)
-                        dispatchAction(actionType, socketIn.attributes());
-                }
-            }
+void Client::switchToBinaryFraming()
+{
+    if (binaryFraming)
+        return;
+
+    // Closed explicitly, an empty element would leave its "/>" pending in the writer until after the switch
+    socketOut.writeStartElement("framing");
+    socketOut.writeAttribute("type", "binary");
+    socketOut.writeAttribute("status", "ok");
+    socketOut.writeEndElement();
+
+    endMessage();
+
+    xmlOut = new QBuffer(this);
+    xmlOut->open(QIODevice::ReadWrite);
+    socketOut.setDevice(xmlOut);
+
+    binaryFraming = true;
+
+    qDebug() << "Client" BOLD BLUE << getIpAddress() << RESET "switched to binary framing";
+}
+
+void Client::readFrames()
+{
+    Framing::Type type;
+    const char *body;
+    int position = 0,
+        length,
+        next;
+
+    while (binaryFraming && (next = Framing::next(frameIn, position, &type, &body, &length)) >= 0) {
+        handleFrame(type, body, length);
+
+        position = next;
+    }
+
+    frameIn.remove(0, position);
+}
+
+void Client::handleFrame(Framing::Type type, const char *body, int length)
+{
+    switch (type) {
+    case Framing::Beat:
+        resetHeartbeatTimer();
+
+        break;
+    case Framing::Authentication:
+        if (length >= 1)
+            requestAuthentication(QString::fromUtf8(body + 1, length - 1), (body[0] & 0x01) != 0);
+
+        break;
+    case Framing::Action: {
+        Parser::Element action = Parser::Unknown;
+
+        switch (length >= 1 ? (uchar) body[0] : 0) {
+        case Framing::ReadyOpcode:
+            action = Parser::Ready;
 
             break;
-        }
-        case QXmlStreamReader::EndElement:
-            if (socketIn.name() == "stream")
-                socket->disconnectFromHost();
+        case Framing::AskDialAuthorizationOpcode:
+            action = Parser::AskDialAuthorization;
 
             break;
-        case QXmlStreamReader::Invalid:
-//            qDebug() << socketIn.errorString();
+        case Framing::SpyOpcode:
+            action = Parser::Spy;
+
             break;
-        default:
-//            qDebug() << "Token:" << tokenType;
+        case Framing::StatusOpcode:
+            action = Parser::Status;
+
             break;
+        case Framing::StatisticsOpcode:
+            action = Parser::Statistics;
+
+            break;
+        }
+
+        if (action != Parser::Unknown)
+            dispatchAction(action, Framing::attributes(body + 1, length - 1));
+
+        break;
+    }
+    case Framing::Logout:
+        socket->disconnectFromHost();
+
+        break;
+    case Framing::Xml:
+        feedFallback(QByteArray(body, length));
+
+        readStream(fallbackIn);
+
+        break;
+    default:
+        break;
+    }
+}
+
+void Client::onSocketReadyRead()
+{
+    readStarted = Metrics::now();
+
+    if (binaryFraming) {
+        Framing::read(socket, &frameIn);
+
+        readFrames();
+
+        return;
+    }
+
+    if (!fastParser) {
+        readStream(socketIn);
+
+        return;
+    }
+
+    parser.read(socket);
+
+    Parser::Token token;
+
+    while (!binaryFraming && parser.next(&token))
+        handleToken(token);
+
+    // Whatever follows the framing switch is already binary
+    if (binaryFraming) {
+        frameIn = parser.pending();
+        parser.clear();
+
+        readFrames();
+    } else {
+        parser.compact();
+
+        // A tag or text that never ends would grow the buffer until allocation fails
+        if (parser.pendingLength() > Parser::MaxPendingLength) {
+            qWarning() << "Client" BOLD BLUE << getIpAddress() << RESET "sent an unterminated element, disconnecting";
+
+            parser.clear();
+
+            socket->abort();
         }
     }
 }
@@ -2,14 +2,26 @@
 #define CLIENT_H
 
 #include <QObject>
-#include <QSettings>
 #include <QTcpSocket>
 #include <QDateTime>
 #include <QXmlStreamReader>
 #include <QXmlStreamWriter>
+#include <QBuffer>
 #include <QSqlQuery>
 #include <QStringList>
 
+#include "statistics.h"
+#include "queue.h"
+#include "parser.h"
+#include "framing.h"
+#include "timingwheel.h"
+#include "configuration.h"
+#include "bufferpool.h"
+#include "statefile.h"
+#include "channel.h"
+#include "groupset.h"
+#include "symbols.h"
+
 class Client : public QObject
 {
     Q_OBJECT
@@ -46,15 +58,79 @@ public:
         QString dnis;
     };
 
-    explicit Client(QObject *parent = 0);
+    // Sent from the worker thread to Service
+    struct Event {
+        enum Type {
+            LoggedIn,
+            LoggedOut,
+            StatusChanged,
+            PhoneStatusChanged,
+            ChangeAgentStatus,
+            ExtensionChanged,
+            AskAuthentication,
+            AuthenticationFinished,
+            AskDialAuthorization,
+            SpyAgentPhone,
+            AskStatistics,
+            Disconnected
+        };
+
+        Type type;
+        Client *client;
+        Status status;
+        bool outbound;
+        int extension; // Symbols, 0 when unknown
+        QStringList arguments; // of the requests, e.g. destination, customer id and campaign of AskDialAuthorization
+        quint64 trace; // Tracer id, 0 when not sampled
+        qint64 posted; // usecs, Metrics::now(), only stamped for traced events
+    };
+
+    // Sent from Service and Groups to the worker thread owning the receiver
+    struct Delivery {
+        enum Type {
+            AgentStatus,
+            AgentLogout,
+            QueueStatus,
+            ChangeStatus,
+            Release
+        };
+
+        Type type;
+        Client *receiver;
+        int username, fullname, group, address, extension; // Symbols, materialized only when written out
+        Phone phone;
+        int handle, abandoned;
+        QDateTime login;
+        Status status;
+        bool outbound;
+        Queue::Snapshot snapshot;
+        qint64 queued; // usecs, Metrics::now()
+        quint64 trace; // Tracer id, 0 when not sampled
+
+        Delivery();
+    };
+
+    explicit Client(ConfigurationPointer configuration, BufferPool *bufferPool = 0, QObject *parent = 0);
     ~Client();
 
+    static const QHash<QString, Status> &statusTable();
+
     QString getIpAddress();
     QString getUsername();
     QString getFullname();
+
+    int getUsernameSymbol();
+    int getFullnameSymbol();
+    int getGroupSymbol(); // the first group, the one agent statuses are sent with
+    int getAddressSymbol();
+    int getExtensionSymbol();
+
     Client::Level getLevel();
+    Client::Status getStatus();
     Client::Phone getPhone();
-    QStringList getGroups();
+    const QStringList &getGroups();
+    const GroupSet &getMemberships();
+    QStringList getSkills();
 
     int getHandle();
     void setHandle(int handle);
@@ -62,36 +138,45 @@ public:
     int getAbandoned();
     void setAbandoned(int abandoned);
 
+    Statistics *getStatistics();
+
     void setSocket(QTcpSocket *socket);
+    void resumeSession(QTcpSocket *socket, QByteArray session);
+    int takeDetachedDescriptor();
+    void setHeartbeatWheel(TimingWheel *heartbeatWheel);
+    void setStateFile(StateFile *stateFile);
+    void setChannels(Channel<Event> *events, Channel<Delivery> *deliveries);
+
+    void deliver(Delivery delivery);
+    void handleDelivery(const Delivery &delivery);
+    void heartbeatExpired();
 
     QString getExtension();
     void setExtension(QString extension);
 
-    void forceLogout(QString status = "server stop services");
+    Q_INVOKABLE void forceLogout(QString status = "server stop services");
 
     void changeStatus(Status status);
     void changePhoneStatus(QString status, bool outbound);
 
-    void sendAgentStatus(QString username,
-                         QString fullname,
+    // Identifiers are Symbols
+    void sendAgentStatus(int username,
+                         int fullname,
                          Phone phone,
                          int handle = 0,
                          int abandoned = 0,
-                         QString group = QString(),
+                         int group = 0,
                          QDateTime login = QDateTime(),
-                         QString address = QString(),
-                         QString extension = QString());
+                         int address = 0,
+                         int extension = 0);
 
-    void sendAgentLogout(QString username,
-                         QString extension,
-                         QString group,
-                         QString address);
+    void sendAgentLogout(int username,
+                         int extension,
+                         int group,
+                         int address);
 
-    void sendDialerResponse(QString formattedNumber);
 
 protected:
-    void timerEvent(QTimerEvent *event);
-
     void logFailedQuery(QSqlQuery *query, QString queryTitle);
 
     QVariant getLastInsertId(QString table, QString column);
@@ -102,51 +187,92 @@ protected:
     void retrieveSkills();
     void retrieveGroups();
     void startSession();
-    void endSession();
+    void continueSession(const StateFile::Record &record);
+    void endSession(QDateTime logoutTime = QDateTime::currentDateTime());
     void startStatus(Status status);
-    void endStatus();
+    void endStatus(QDateTime finish = QDateTime::currentDateTime());
     void endLogging();
 
-    void resetHeartbeatTimer();
+    void requestAuthentication(QString authentication, bool encrypted);
     void checkAuthentication(QString authentication, bool encrypted);
-    void dispatchAction(QString actionType, QXmlStreamAttributes attributes);
+    void dispatchAction(Parser::Element action, QXmlStreamAttributes attributes);
+
+    void readStream(QXmlStreamReader *reader);
+    void feedFallback(const QByteArray &data);
+    void handleToken(const Parser::Token &token);
+
+    void connectSocket();
+    void internSymbols();
+    void post(Event::Type type, Status status = Login, bool outbound = false, int extension = 0, const QStringList &arguments = QStringList());
+    void post(Event::Type type, const QStringList &arguments);
+
+    void endMessage();
+    void switchToBinaryFraming();
+    void readFrames();
+    void handleFrame(Framing::Type type, const char *body, int length);
 
 private:
-    QSettings *settings;
+    ConfigurationPointer configuration;
+    BufferPool *bufferPool;
     QTcpSocket *socket;
-    QXmlStreamReader socketIn;
-    QXmlStreamWriter socketOut;
-    QHash<QString, Status> statusText;
+    QXmlStreamReader *socketIn; // only when the fast parser is turned off
+    QXmlStreamWriter socketOut; // every client writes, it is the one reader or writer set up on construction
+
+    Parser parser;
+    QXmlStreamReader *fallbackIn; // created on the first element the fast parser hands over
+    Parser::Element actionElement;
+    QString authenticationText;
+    int fallbackDepth;
+    qint64 readStarted; // usecs, Metrics::now(), start of the read being dispatched
+    bool fastParser, actionOpen, authenticationOpen, authenticationEncrypted;
 
-    int heartbeatTimerId;
+    QBuffer *xmlOut; // binary framing only, collects the messages that travel as XML frames
+    QByteArray frameIn;
+    bool binaryFraming;
+    int detachedDescriptor;
+
+    TimingWheel *heartbeatWheel;
+    TimingWheel::Entry heartbeatEntry;
+    StateFile *stateFile;
+    Channel<Event> *events;
+    Channel<Delivery> *deliveries;
+    int stateSlot;
+    QDateTime loginTime;
+    QString pendingAuthentication;
+    bool pendingEncrypted, authenticationPending;
     quint32 agentId, agentExtenMapId;
     quint64 agentLogSessionId, agentLogStatusId;
+    quint64 trace; // of the request being handled, carried into the events it posts
 
-    QString username, fullname, extension;
-    QStringList groups;
+    QString username, fullname, extension, address;
+    QStringList groups, skills;
+    int usernameSymbol, fullnameSymbol, groupSymbol, addressSymbol, extensionSymbol;
+    GroupSet memberships; // the same groups, as a bitset
 
     Level level;
     Status status;
     Phone phone;
     int handle, abandoned;
+    Statistics statistics;
+
+public slots:
+    void resetHeartbeatTimer();
+    QByteArray detach();
+    void updateStateRecord();
+    void adoptStateSlot(int slot);
+
+    void authenticate();
+    void sendAuthenticationQueued(int position);
+    void sendAuthenticationRejected(QString message);
+    void sendStatistics(QString group, QString window, Statistics::Report report);
+    void sendQueueStatus(Queue::Snapshot snapshot);
+    void sendSpyResponse(QString agentUsername, QString mode, bool succeed, QString message);
+    void sendDialerResponse(QString destination, QString formattedNumber, QString status, QString trunk);
 
 protected slots:
     void onSocketDisconnected();
     void onSocketError(QAbstractSocket::SocketError socketError);
     void onSocketReadyRead();
-
-signals:
-    void socketDisconnected();
-
-    void userLoggedIn();
-    void userLoggedOut();
-    void userExtensionChanged(QString extension);
-    void userStatusChanged(Client::Status status);
-    void phoneStatusChanged(QString status);
-
-    void askDialAuthorization(QString destination, QString customerId, QString campaign);
-    void spyAgentPhone(QString agentUsername);
-    void changeAgentStatus(Client::Status status, bool outbound, QString extension);
 };
 
 #endif // CLIENT_H
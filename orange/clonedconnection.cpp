@@ -0,0 +1,18 @@
+#include "clonedconnection.h"
+
+ClonedConnection::ClonedConnection(const QSqlDatabase &source, QString name) :
+    name(name)
+{
+    // Cloned here rather than by the owner, a connection only works from the thread that added it
+    QSqlDatabase::cloneDatabase(source, name);
+}
+
+ClonedConnection::~ClonedConnection()
+{
+    QSqlDatabase::removeDatabase(name);
+}
+
+QSqlDatabase ClonedConnection::database()
+{
+    return QSqlDatabase::database(name);
+}
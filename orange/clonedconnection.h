@@ -0,0 +1,21 @@
+#ifndef CLONEDCONNECTION_H
+#define CLONEDCONNECTION_H
+
+#include <QSqlDatabase>
+#include <QString>
+
+// Clone of a connection owned by the thread creating it, removed again once it goes out of scope,
+// queries and handles on it have to be gone by then
+class ClonedConnection
+{
+public:
+    ClonedConnection(const QSqlDatabase &source, QString name);
+    ~ClonedConnection();
+
+    QSqlDatabase database();
+
+private:
+    QString name;
+};
+
+#endif // CLONEDCONNECTION_H
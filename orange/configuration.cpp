@@ -0,0 +1,14 @@
+#include "configuration.h"
+
+Configuration::Configuration(QSettings *settings) :
+    singleQuoteHandshake(settings->value("orange/single_quote_handshake", false).toBool()),
+    fastParser(settings->value("orange/fast_parser", true).toBool()),
+    shiftHours(settings->value("orange/shift_hours", 8).toInt()),
+    heartbeatTimeout(settings->value("orange/heartbeat_timeout", 20).toInt()),
+    loginConcurrency(settings->value("orange/login_concurrency", 8).toInt()),
+    ingestBatchSize(settings->value("ingest/batch_size", 500).toInt()),
+    ingestFlushInterval(settings->value("ingest/flush_interval", 1000).toInt()),
+    queuePushInterval(settings->value("orange/queue_push_interval", 2000).toInt()),
+    ignoredEvents(settings->value("asterisk/ignored_events").toStringList())
+{
+}
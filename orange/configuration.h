@@ -0,0 +1,22 @@
+#ifndef CONFIGURATION_H
+#define CONFIGURATION_H
+
+#include <QSettings>
+#include <QSharedPointer>
+#include <QStringList>
+
+// Immutable snapshot of the tunable settings, read once and shared by every Client until the next reload
+class Configuration
+{
+public:
+    explicit Configuration(QSettings *settings);
+
+    const bool singleQuoteHandshake, fastParser;
+    const int shiftHours, heartbeatTimeout;
+    const int loginConcurrency, ingestBatchSize, ingestFlushInterval, queuePushInterval;
+    const QStringList ignoredEvents; // AMI events dropped before dispatching
+};
+
+typedef QSharedPointer<const Configuration> ConfigurationPointer;
+
+#endif // CONFIGURATION_H
@@ -0,0 +1,56 @@
+#include <QJsonDocument>
+
+#include "controlserver.h"
+
+ControlServer::ControlServer(QObject *parent) :
+    QLocalServer(parent)
+{
+    connect(this, SIGNAL(newConnection()), SLOT(onNewConnection()));
+
+    // Kicking agents and reloading are not for every local user
+    setSocketOptions(QLocalServer::UserAccessOption);
+}
+
+bool ControlServer::listenOn(QString path)
+{
+    // A socket file left over by a crashed process would make listen() fail
+    QLocalServer::removeServer(path);
+
+    return listen(path);
+}
+
+void ControlServer::reply(QLocalSocket *socket, QJsonObject response)
+{
+    socket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
+    socket->write("\n");
+}
+
+void ControlServer::onNewConnection()
+{
+    while (hasPendingConnections()) {
+        QLocalSocket *socket = nextPendingConnection();
+
+        connect(socket, SIGNAL(readyRead()), SLOT(onSocketReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void ControlServer::onSocketReadyRead()
+{
+    QLocalSocket *socket = (QLocalSocket *) sender();
+
+    while (socket->canReadLine()) {
+        QStringList request = QString::fromUtf8(socket->readLine(MaxLineLength)).simplified().split(' ', QString::SkipEmptyParts);
+
+        if (!request.isEmpty())
+            emit requestReceived(socket, request);
+    }
+
+    if (socket->bytesAvailable() > MaxLineLength) {
+        QJsonObject response;
+        response["error"] = QString("request too long");
+
+        reply(socket, response);
+        socket->disconnectFromServer();
+    }
+}
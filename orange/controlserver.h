@@ -0,0 +1,32 @@
+#ifndef CONTROLSERVER_H
+#define CONTROLSERVER_H
+
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QJsonObject>
+#include <QStringList>
+
+// Local socket taking one command per line from orangectl, each answered by a single line of JSON
+class ControlServer : public QLocalServer
+{
+    Q_OBJECT
+
+public:
+    enum {
+        MaxLineLength = 4096
+    };
+
+    explicit ControlServer(QObject *parent = 0);
+
+    bool listenOn(QString path);
+    void reply(QLocalSocket *socket, QJsonObject response);
+
+private slots:
+    void onNewConnection();
+    void onSocketReadyRead();
+
+signals:
+    void requestReceived(QLocalSocket *socket, QStringList request);
+};
+
+#endif // CONTROLSERVER_H
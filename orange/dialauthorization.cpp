@@ -0,0 +1,271 @@
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+
+#include <algorithm>
+
+#include "terminal.h"
+#include "clonedconnection.h"
+#include "dialauthorization.h"
+
+DialAuthorization::DialAuthorization(QSqlDatabase source, DialAuthorization::Numbering numbering, QObject *parent) :
+    QThread(parent),
+    source(source),
+    connectionName("dial-authorization"),
+    numbering(numbering),
+    loaded(false)
+{
+    // Numbers are indexed as integers, E.164 never goes past 15 digits anyway
+    this->numbering.maximumLength = qMin(numbering.maximumLength, 18);
+}
+
+DialAuthorization::~DialAuthorization()
+{
+    wait();
+}
+
+DialAuthorization::Result DialAuthorization::authorize(QString destination, QString campaign)
+{
+    Result result;
+    result.verdict = Allowed;
+    result.number = normalize(destination);
+
+    mutex.lock();
+    QSharedPointer<const Index> index = this->index;
+    mutex.unlock();
+
+    if (result.number.isEmpty()) {
+        result.verdict = InvalidNumber;
+
+        return result;
+    }
+
+    // Nothing has been loaded yet, dialing blind could call a listed number
+    if (index.isNull()) {
+        result.verdict = Unavailable;
+
+        return result;
+    }
+
+    if (std::binary_search(index->doNotCall.constBegin(), index->doNotCall.constEnd(), result.number.toULongLong())) {
+        result.verdict = DoNotCall;
+
+        return result;
+    }
+
+    int longest = qMin(index->longestPrefix, result.number.length());
+
+    // A campaign without any prefix listed may dial anywhere
+    if (!campaign.isEmpty() && index->campaigns.contains(campaign)) {
+        QSet<QString> prefixes = index->campaigns.value(campaign);
+        bool allowed = false;
+
+        for (int length = longest; length > 0 && !allowed; --length)
+            allowed = prefixes.contains(result.number.left(length));
+
+        if (!allowed) {
+            result.verdict = CampaignNotAllowed;
+
+            return result;
+        }
+    }
+
+    // Without any trunk rule the normalised number is dialed as it is
+    if (index->trunks.isEmpty()) {
+        result.dial = result.number;
+
+        return result;
+    }
+
+    for (int length = longest; length > 0; --length) {
+        QHash<QString, Trunk>::const_iterator trunk = index->trunks.constFind(result.number.left(length));
+
+        if (trunk != index->trunks.constEnd()) {
+            result.dial = trunk.value().prepend + result.number.mid(trunk.value().strip);
+            result.trunk = trunk.value().name;
+
+            return result;
+        }
+    }
+
+    result.verdict = NoRoute;
+
+    return result;
+}
+
+bool DialAuthorization::isLoaded()
+{
+    QMutexLocker locker(&mutex);
+
+    return loaded;
+}
+
+QString DialAuthorization::verdictText(DialAuthorization::Verdict verdict)
+{
+    switch (verdict) {
+    case Allowed:
+        return "allowed";
+    case InvalidNumber:
+        return "invalid-number";
+    case DoNotCall:
+        return "do-not-call";
+    case CampaignNotAllowed:
+        return "campaign-not-allowed";
+    case NoRoute:
+        return "no-route";
+    case Unavailable:
+        break;
+    }
+
+    return "unavailable";
+}
+
+void DialAuthorization::run()
+{
+    QSharedPointer<Index> index(new Index);
+    index->longestPrefix = 0;
+
+    mutex.lock();
+    loaded = false;
+    mutex.unlock();
+
+    {
+        ClonedConnection clone(source, connectionName);
+        QSqlDatabase connection = clone.database();
+
+        if (!connection.isOpen()) {
+            qWarning() << "Dial authorization connection failed:" BOLD CYAN << connection.lastError().text() << RESET;
+
+            return;
+        }
+
+        QSqlQuery retrieveNumbers(connection);
+
+        // Millions of rows, streamed instead of cached by the driver
+        retrieveNumbers.setForwardOnly(true);
+
+        if (!retrieveNumbers.exec("SELECT number FROM acd_do_not_call")) {
+            qWarning() << "Do-not-call query failed:" BOLD CYAN << retrieveNumbers.lastError().text() << RESET;
+
+            return;
+        }
+
+        while (retrieveNumbers.next()) {
+            QString number = normalize(retrieveNumbers.value(0).toString());
+
+            if (!number.isEmpty())
+                index->doNotCall.append(number.toULongLong());
+        }
+
+        std::sort(index->doNotCall.begin(), index->doNotCall.end());
+        index->doNotCall.erase(std::unique(index->doNotCall.begin(), index->doNotCall.end()), index->doNotCall.end());
+        index->doNotCall.squeeze();
+
+        QSqlQuery retrieveRules(connection);
+
+        if (!retrieveRules.exec("SELECT prefix, trunk, strip, prepend FROM acd_dial_rule")) {
+            qWarning() << "Dial rule query failed:" BOLD CYAN << retrieveRules.lastError().text() << RESET;
+
+            return;
+        }
+
+        while (retrieveRules.next()) {
+            Trunk trunk;
+            trunk.name = retrieveRules.value(1).toString();
+            trunk.strip = retrieveRules.value(2).toInt();
+            trunk.prepend = retrieveRules.value(3).toString();
+
+            QString prefix = normalizePrefix(retrieveRules.value(0).toString());
+
+            if (prefix.isEmpty()) {
+                qWarning() << "Dial rule prefix ignored:" BOLD CYAN << retrieveRules.value(0).toString() << RESET;
+
+                continue;
+            }
+
+            index->trunks.insert(prefix, trunk);
+            index->longestPrefix = qMax(index->longestPrefix, prefix.length());
+        }
+
+        QSqlQuery retrieveCampaigns(connection);
+
+        if (!retrieveCampaigns.exec("SELECT campaign, prefix FROM acd_campaign_prefix")) {
+            qWarning() << "Campaign prefix query failed:" BOLD CYAN << retrieveCampaigns.lastError().text() << RESET;
+
+            return;
+        }
+
+        while (retrieveCampaigns.next()) {
+            QString prefix = normalizePrefix(retrieveCampaigns.value(1).toString());
+
+            if (prefix.isEmpty()) {
+                qWarning() << "Campaign prefix ignored:" BOLD CYAN << retrieveCampaigns.value(1).toString() << RESET;
+
+                continue;
+            }
+
+            index->campaigns[retrieveCampaigns.value(0).toString()].insert(prefix);
+            index->longestPrefix = qMax(index->longestPrefix, prefix.length());
+        }
+
+        connection.close();
+    }
+
+    QMutexLocker locker(&mutex);
+
+    this->index = index;
+    loaded = true;
+
+    qDebug() << "Dial authorization loaded, do-not-call numbers:" BOLD BLUE << index->doNotCall.count() << RESET
+             << "trunk rules:" BOLD BLUE << index->trunks.count() << RESET
+             << "campaigns:" BOLD BLUE << index->campaigns.count() << RESET;
+}
+
+QString DialAuthorization::normalize(QString destination)
+{
+    QString digits = toInternational(destination);
+
+    if (digits.length() < numbering.minimumLength || digits.length() > numbering.maximumLength)
+        return QString();
+
+    return digits;
+}
+
+QString DialAuthorization::normalizePrefix(QString prefix)
+{
+    // Rule prefixes are compared with normalised numbers, so they go through the same conversion
+    QString digits = toInternational(prefix);
+
+    if (digits.length() > numbering.maximumLength)
+        return QString();
+
+    return digits;
+}
+
+QString DialAuthorization::toInternational(QString destination)
+{
+    QString digits;
+    bool international = false;
+
+    for (int i = 0; i < destination.length(); ++i) {
+        QChar character = destination.at(i);
+
+        // Only ASCII digits, QChar::isDigit() would let other scripts through and toULongLong() turn them into 0
+        if (character >= '0' && character <= '9')
+            digits.append(character);
+        else if (character == '+' && digits.isEmpty())
+            international = true;
+        else if (character != ' ' && character != '-' && character != '.' && character != '(' && character != ')')
+            return QString();
+    }
+
+    if (!international && !numbering.internationalPrefix.isEmpty() && digits.startsWith(numbering.internationalPrefix))
+        digits.remove(0, numbering.internationalPrefix.length());
+    else if (!international && !numbering.nationalPrefix.isEmpty() && digits.startsWith(numbering.nationalPrefix))
+        digits.replace(0, numbering.nationalPrefix.length(), numbering.countryCode);
+
+    if (digits.startsWith('0'))
+        return QString();
+
+    return digits;
+}
@@ -0,0 +1,78 @@
+#ifndef DIALAUTHORIZATION_H
+#define DIALAUTHORIZATION_H
+
+#include <QThread>
+#include <QMutex>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QSharedPointer>
+#include <QSqlDatabase>
+
+// Do-not-call list, campaign allowlists and trunk rules compiled into an index on its own connection,
+// every reload builds a new index and swaps it in whole, dials in between keep using the previous one
+class DialAuthorization : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum Verdict {
+        Allowed,
+        InvalidNumber,
+        DoNotCall,
+        CampaignNotAllowed,
+        NoRoute,
+        Unavailable
+    };
+
+    struct Numbering {
+        QString countryCode; // 62
+        QString nationalPrefix; // 0, replaced by the country code
+        QString internationalPrefix; // 00, dropped like a leading +
+        int minimumLength, maximumLength; // digits once normalised
+    };
+
+    struct Result {
+        Verdict verdict;
+        QString number; // normalised, country code first without the +
+        QString dial; // what the dialer should call, once the trunk rule is applied
+        QString trunk;
+    };
+
+    explicit DialAuthorization(QSqlDatabase source, Numbering numbering, QObject *parent = 0);
+    ~DialAuthorization();
+
+    Result authorize(QString destination, QString campaign);
+    bool isLoaded();
+
+    static QString verdictText(Verdict verdict);
+
+    void run();
+
+private:
+    struct Trunk {
+        QString name, prepend;
+        int strip;
+    };
+
+    // Never changed once published, lookups read it without holding the mutex
+    struct Index {
+        QVector<quint64> doNotCall; // sorted
+        QHash<QString, Trunk> trunks; // key: number prefix
+        QHash<QString, QSet<QString> > campaigns; // key: campaign, value: allowed number prefixes
+        int longestPrefix;
+    };
+
+    QSqlDatabase source; // never used from here, only cloned by run()
+    QString connectionName;
+    Numbering numbering;
+    QMutex mutex;
+    QSharedPointer<const Index> index;
+    bool loaded;
+
+    QString normalize(QString destination);
+    QString normalizePrefix(QString prefix);
+    QString toInternational(QString destination);
+};
+
+#endif // DIALAUTHORIZATION_H
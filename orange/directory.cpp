@@ -0,0 +1,70 @@
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+
+#include "terminal.h"
+#include "clonedconnection.h"
+#include "directory.h"
+
+Directory::Directory(QSqlDatabase source, QObject *parent) :
+    QThread(parent),
+    source(source),
+    connectionName("directory"),
+    loaded(false)
+{
+}
+
+Directory::~Directory()
+{
+    wait();
+}
+
+QHash<QString, Client::Level> Directory::getLevels()
+{
+    QMutexLocker locker(&mutex);
+
+    return levels;
+}
+
+bool Directory::isLoaded()
+{
+    QMutexLocker locker(&mutex);
+
+    return loaded;
+}
+
+void Directory::run()
+{
+    QHash<QString, Client::Level> levels;
+
+    {
+        ClonedConnection clone(source, connectionName);
+        QSqlDatabase connection = clone.database();
+
+        if (!connection.isOpen()) {
+            qWarning() << "Directory connection failed:" BOLD CYAN << connection.lastError().text() << RESET;
+
+            return;
+        }
+
+        QSqlQuery retrieveAgents(connection);
+
+        if (!retrieveAgents.exec("SELECT name, level FROM acd_agent")) {
+            qWarning() << "Directory query failed:" BOLD CYAN << retrieveAgents.lastError().text() << RESET;
+
+            return;
+        }
+
+        while (retrieveAgents.next())
+            levels.insert(retrieveAgents.value(0).toString(), (Client::Level) retrieveAgents.value(1).toUInt());
+
+        connection.close();
+    }
+
+    QMutexLocker locker(&mutex);
+
+    this->levels = levels;
+    loaded = true;
+
+    qDebug() << "Directory loaded, agents:" BOLD BLUE << levels.count() << RESET;
+}
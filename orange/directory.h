@@ -0,0 +1,33 @@
+#ifndef DIRECTORY_H
+#define DIRECTORY_H
+
+#include <QThread>
+#include <QMutex>
+#include <QHash>
+#include <QSqlDatabase>
+
+#include "client.h"
+
+// Cache of agent levels, loaded on its own connection while the rest of the service starts
+class Directory : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit Directory(QSqlDatabase source, QObject *parent = 0);
+    ~Directory();
+
+    QHash<QString, Client::Level> getLevels();
+    bool isLoaded();
+
+    void run();
+
+private:
+    QSqlDatabase source; // never used from here, only cloned by run()
+    QString connectionName;
+    QMutex mutex;
+    QHash<QString, Client::Level> levels; // key: Username
+    bool loaded;
+};
+
+#endif // DIRECTORY_H
@@ -0,0 +1,285 @@
+#include <QDateTime>
+#include <QTimerEvent>
+#include <QDebug>
+
+#include "terminal.h"
+#include "distributor.h"
+
+bool Distributor::AgentHeap::isEmpty()
+{
+    return entries.isEmpty();
+}
+
+int Distributor::AgentHeap::count()
+{
+    return entries.count();
+}
+
+void Distributor::AgentHeap::push(Distributor::AgentHeap::Entry entry)
+{
+    if (positions.contains(entry.client))
+        remove(entry.client);
+
+    entries.append(entry);
+    positions.insert(entry.client, entries.count() - 1);
+
+    siftUp(entries.count() - 1);
+}
+
+void Distributor::AgentHeap::remove(Client *client)
+{
+    int index = positions.value(client, -1);
+
+    if (index < 0)
+        return;
+
+    positions.remove(client);
+
+    Entry last = entries.last();
+    entries.removeLast();
+
+    if (index < entries.count()) {
+        place(index, last);
+        siftUp(index);
+        siftDown(positions.value(last.client));
+    }
+}
+
+Client *Distributor::AgentHeap::pop()
+{
+    if (entries.isEmpty())
+        return NULL;
+
+    Client *client = entries.first().client;
+
+    remove(client);
+
+    return client;
+}
+
+bool Distributor::AgentHeap::before(const Distributor::AgentHeap::Entry &first, const Distributor::AgentHeap::Entry &second)
+{
+    if (first.skilled != second.skilled)
+        return first.skilled;
+
+    return first.readySince < second.readySince;
+}
+
+void Distributor::AgentHeap::place(int index, Distributor::AgentHeap::Entry entry)
+{
+    entries[index] = entry;
+    positions[entry.client] = index;
+}
+
+void Distributor::AgentHeap::siftUp(int index)
+{
+    Entry entry = entries.at(index);
+
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+
+        if (!before(entry, entries.at(parent)))
+            break;
+
+        place(index, entries.at(parent));
+        index = parent;
+    }
+
+    place(index, entry);
+}
+
+void Distributor::AgentHeap::siftDown(int index)
+{
+    Entry entry = entries.at(index);
+    int count = entries.count();
+
+    forever {
+        int child = index * 2 + 1;
+
+        if (child >= count)
+            break;
+
+        if (child + 1 < count && before(entries.at(child + 1), entries.at(child)))
+            child++;
+
+        if (!before(entries.at(child), entry))
+            break;
+
+        place(index, entries.at(child));
+        index = child;
+    }
+
+    place(index, entry);
+}
+
+Distributor::Distributor(QObject *parent, int reservationTimeout) :
+    QObject(parent),
+    reservationTimeout(reservationTimeout)
+{
+    connect(&agiServer, SIGNAL(newConnection()), SLOT(onAgiServerNewConnection()));
+
+    timer.start(1000, this);
+
+    qDebug("Distributor initialized");
+}
+
+Distributor::~Distributor()
+{
+    qDebug("Distributor destroyed");
+}
+
+bool Distributor::listen(quint16 port)
+{
+    bool listening = agiServer.listen(QHostAddress::Any, port);
+
+    if (listening)
+        qDebug() << "Distributor FastAGI listening on port:" BOLD BLUE << port << RESET;
+    else
+        qWarning() << "Distributor FastAGI failed to listen on port:" BOLD BLUE << port << RESET;
+
+    return listening;
+}
+
+void Distributor::updateClient(Client *client, Client::Status status)
+{
+    if (status == Client::Ready) {
+        readyClients.insert(client, QDateTime::currentMSecsSinceEpoch());
+        reservations.remove(client);
+
+        pushReady(client);
+    } else {
+        removeReady(client);
+    }
+}
+
+void Distributor::removeClient(Client *client)
+{
+    removeReady(client);
+}
+
+Client *Distributor::nextAgent(QString queue)
+{
+    if (!heaps.contains(queue))
+        return NULL;
+
+    Client *client = heaps[queue].pop();
+
+    if (client != NULL) {
+        // A reserved agent is offered to no other queue until the call reaches them or the reservation expires
+        foreach (QString group, client->getGroups()) {
+            if (heaps.contains(group))
+                heaps[group].remove(client);
+        }
+
+        reservations.insert(client, QDateTime::currentMSecsSinceEpoch());
+    }
+
+    return client;
+}
+
+void Distributor::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != timer.timerId())
+        return;
+
+    qint64 expiry = QDateTime::currentMSecsSinceEpoch() - reservationTimeout * 1000;
+
+    QMutableHashIterator<Client *, qint64> reservation(reservations);
+    while (reservation.hasNext()) {
+        reservation.next();
+
+        if (reservation.value() < expiry) {
+            Client *client = reservation.key();
+
+            reservation.remove();
+
+            if (readyClients.contains(client))
+                pushReady(client);
+        }
+    }
+}
+
+void Distributor::pushReady(Client *client)
+{
+    QStringList skills = client->getSkills();
+
+    // Skills are loaded as names only, an agent holding the one named like the queue goes first, level is not graded
+    foreach (QString group, client->getGroups()) {
+        AgentHeap::Entry entry;
+        entry.client = client;
+        entry.skilled = skills.contains(group);
+        entry.readySince = readyClients.value(client);
+
+        heaps[group].push(entry);
+    }
+}
+
+void Distributor::removeReady(Client *client)
+{
+    readyClients.remove(client);
+    reservations.remove(client);
+
+    foreach (QString group, client->getGroups()) {
+        if (heaps.contains(group))
+            heaps[group].remove(client);
+    }
+}
+
+void Distributor::handleAgiRequest(QTcpSocket *socket)
+{
+    QString queue = socket->property("queue").toString();
+    Client *client = nextAgent(queue);
+
+    if (client != NULL) {
+        socket->write(QString("SET VARIABLE ORANGE_AGENT \"%1\"\n").arg(client->getExtension()).toLatin1());
+        socket->write(QString("SET VARIABLE ORANGE_AGENT_USERNAME \"%1\"\n").arg(client->getUsername()).toLatin1());
+
+        socket->setProperty("pending", 2);
+
+        qDebug() << "Distributor routed call from queue" BOLD BLUE << queue << RESET "to" BOLD BLUE << client->getUsername() << RESET;
+    } else {
+        socket->write("SET VARIABLE ORANGE_AGENT \"\"\n");
+
+        socket->setProperty("pending", 1);
+    }
+}
+
+void Distributor::onAgiServerNewConnection()
+{
+    while (agiServer.hasPendingConnections()) {
+        QTcpSocket *socket = agiServer.nextPendingConnection();
+
+        connect(socket, SIGNAL(readyRead()), SLOT(onAgiSocketReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void Distributor::onAgiSocketReadyRead()
+{
+    QTcpSocket *socket = (QTcpSocket *) sender();
+
+    while (socket->canReadLine()) {
+        QString line = QString(socket->readLine()).trimmed();
+
+        if (socket->property("pending").isValid()) {
+            // Responses to our SET VARIABLE commands, the session ends once all of them are acknowledged
+            int pending = socket->property("pending").toInt() - 1;
+
+            socket->setProperty("pending", pending);
+
+            if (pending <= 0)
+                socket->disconnectFromHost();
+        } else if (line.isEmpty()) {
+            handleAgiRequest(socket);
+        } else if (line.startsWith("agi_arg_1:")) {
+            socket->setProperty("queue", line.section(':', 1).trimmed());
+        } else if (line.startsWith("agi_network_script:") && !socket->property("queue").isValid()) {
+            QString query = line.section(':', 1).trimmed().section('?', 1);
+
+            foreach (QString item, query.split('&')) {
+                if (item.section('=', 0, 0) == "queue")
+                    socket->setProperty("queue", item.section('=', 1));
+            }
+        }
+    }
+}
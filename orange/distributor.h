@@ -0,0 +1,77 @@
+#ifndef DISTRIBUTOR_H
+#define DISTRIBUTOR_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QVector>
+#include <QHash>
+#include <QBasicTimer>
+
+#include "client.h"
+
+class Distributor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Distributor(QObject *parent = 0, int reservationTimeout = 30);
+    ~Distributor();
+
+    bool listen(quint16 port);
+
+    void updateClient(Client *client, Client::Status status);
+    void removeClient(Client *client);
+
+    Client *nextAgent(QString queue);
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private:
+    // Binary heap of Ready agents with a position index, so that removal of any agent is O(log n) as well
+    class AgentHeap
+    {
+    public:
+        struct Entry {
+            Client *client;
+            bool skilled; // a skill named after the queue, acd_agent_skill carries no level to rank by
+            qint64 readySince;
+        };
+
+        bool isEmpty();
+        int count();
+
+        void push(Entry entry);
+        void remove(Client *client);
+        Client *pop();
+
+    private:
+        QVector<Entry> entries;
+        QHash<Client *, int> positions;
+
+        static bool before(const Entry &first, const Entry &second);
+
+        void place(int index, Entry entry);
+        void siftUp(int index);
+        void siftDown(int index);
+    };
+
+    QTcpServer agiServer;
+    QHash<QString, AgentHeap> heaps; // key: Queue/Group name
+    QHash<Client *, qint64> readyClients; // value: msecs since Ready
+    QHash<Client *, qint64> reservations; // value: msecs when reserved
+    QBasicTimer timer;
+    int reservationTimeout;
+
+    void pushReady(Client *client);
+    void removeReady(Client *client);
+
+    void handleAgiRequest(QTcpSocket *socket);
+
+private slots:
+    void onAgiServerNewConnection();
+    void onAgiSocketReadyRead();
+};
+
+#endif // DISTRIBUTOR_H
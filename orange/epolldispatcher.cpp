@@ -0,0 +1,331 @@
+#include <QCoreApplication>
+#include <QSocketNotifier>
+#include <QDebug>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "terminal.h"
+#include "epolldispatcher.h"
+
+EpollDispatcher::Descriptor::Descriptor() :
+    ready(0),
+    queued(false)
+{
+    notifiers[QSocketNotifier::Read] = NULL;
+    notifiers[QSocketNotifier::Write] = NULL;
+    notifiers[QSocketNotifier::Exception] = NULL;
+}
+
+EpollDispatcher::EpollDispatcher(QObject *parent) :
+    QAbstractEventDispatcher(parent),
+    epollDescriptor(::epoll_create1(EPOLL_CLOEXEC)),
+    wakeupDescriptor(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    interrupted(0)
+{
+    clock.start();
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = wakeupDescriptor;
+
+    if (epollDescriptor < 0 || wakeupDescriptor < 0 || ::epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, wakeupDescriptor, &event) < 0)
+        qCritical("Epoll dispatcher could not be initialized");
+}
+
+EpollDispatcher::~EpollDispatcher()
+{
+    ::close(wakeupDescriptor);
+    ::close(epollDescriptor);
+}
+
+bool EpollDispatcher::processEvents(QEventLoop::ProcessEventsFlags flags)
+{
+    interrupted.store(0);
+
+    emit awake();
+
+    QCoreApplication::sendPostedEvents();
+
+    bool wait = (flags & QEventLoop::WaitForMoreEvents) && interrupted.load() == 0 && readyList.isEmpty();
+    int timeout = wait ? timeUntilNextTimer() : 0;
+
+    if (wait)
+        emit aboutToBlock();
+
+    struct epoll_event events[MaxEvents];
+    int count = ::epoll_wait(epollDescriptor, events, MaxEvents, timeout);
+
+    if (count < 0 && errno != EINTR)
+        qWarning() << "Epoll wait failed:" BOLD CYAN << strerror(errno) << RESET;
+
+    for (int i = 0; i < count; ++i) {
+        int descriptor = events[i].data.fd;
+
+        if (descriptor == wakeupDescriptor) {
+            quint64 value;
+            ::read(wakeupDescriptor, &value, sizeof(value));
+
+            continue;
+        }
+
+        if (descriptor >= descriptors.count())
+            continue;
+
+        Descriptor &entry = descriptors[descriptor];
+
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            entry.ready |= 1 << QSocketNotifier::Read;
+
+        if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+            entry.ready |= 1 << QSocketNotifier::Write;
+
+        if (events[i].events & EPOLLPRI)
+            entry.ready |= 1 << QSocketNotifier::Exception;
+
+        if (!entry.queued) {
+            entry.queued = true;
+
+            readyList.append(descriptor);
+        }
+    }
+
+    bool activated = activateReady();
+
+    if (!(flags & QEventLoop::X11ExcludeTimers))
+        activated = activateTimers() || activated;
+
+    return activated || count > 0;
+}
+
+bool EpollDispatcher::hasPendingEvents()
+{
+    return !readyList.isEmpty();
+}
+
+void EpollDispatcher::registerSocketNotifier(QSocketNotifier *notifier)
+{
+    int descriptor = notifier->socket();
+
+    if (descriptor < 0)
+        return;
+
+    if (descriptor >= descriptors.count())
+        descriptors.resize(qMax(descriptor + 1, descriptors.count() * 2));
+
+    descriptors[descriptor].notifiers[notifier->type()] = notifier;
+
+    updateInterest(descriptor);
+}
+
+void EpollDispatcher::unregisterSocketNotifier(QSocketNotifier *notifier)
+{
+    int descriptor = notifier->socket();
+
+    if (descriptor < 0 || descriptor >= descriptors.count())
+        return;
+
+    Descriptor &entry = descriptors[descriptor];
+
+    if (entry.notifiers[notifier->type()] != notifier)
+        return;
+
+    entry.notifiers[notifier->type()] = NULL;
+    entry.ready &= ~(1 << notifier->type());
+
+    updateInterest(descriptor);
+}
+
+void EpollDispatcher::registerTimer(int timerId, int interval, Qt::TimerType timerType, QObject *object)
+{
+    Timer timer;
+    timer.interval = interval;
+    timer.type = timerType;
+    timer.object = object;
+    timer.deadline = clock.elapsed() + interval;
+
+    timers.insert(timerId, timer);
+}
+
+bool EpollDispatcher::unregisterTimer(int timerId)
+{
+    return timers.remove(timerId) > 0;
+}
+
+bool EpollDispatcher::unregisterTimers(QObject *object)
+{
+    bool removed = false;
+
+    QMutableHashIterator<int, Timer> timer(timers);
+    while (timer.hasNext()) {
+        timer.next();
+
+        if (timer.value().object == object) {
+            timer.remove();
+
+            removed = true;
+        }
+    }
+
+    return removed;
+}
+
+QList<QAbstractEventDispatcher::TimerInfo> EpollDispatcher::registeredTimers(QObject *object) const
+{
+    QList<TimerInfo> registered;
+
+    QHashIterator<int, Timer> timer(timers);
+    while (timer.hasNext()) {
+        timer.next();
+
+        if (timer.value().object == object)
+            registered << TimerInfo(timer.key(), timer.value().interval, timer.value().type);
+    }
+
+    return registered;
+}
+
+int EpollDispatcher::remainingTime(int timerId)
+{
+    if (!timers.contains(timerId))
+        return -1;
+
+    return (int) qMax(timers.value(timerId).deadline - clock.elapsed(), (qint64) 0);
+}
+
+void EpollDispatcher::wakeUp()
+{
+    quint64 value = 1;
+
+    ::write(wakeupDescriptor, &value, sizeof(value));
+}
+
+void EpollDispatcher::interrupt()
+{
+    interrupted.store(1);
+
+    wakeUp();
+}
+
+void EpollDispatcher::flush()
+{
+}
+
+void EpollDispatcher::updateInterest(int descriptor)
+{
+    Descriptor &entry = descriptors[descriptor];
+
+    struct epoll_event event;
+    event.events = EPOLLET;
+    event.data.fd = descriptor;
+
+    if (entry.notifiers[QSocketNotifier::Read] != NULL)
+        event.events |= EPOLLIN | EPOLLRDHUP;
+
+    if (entry.notifiers[QSocketNotifier::Write] != NULL)
+        event.events |= EPOLLOUT;
+
+    if (entry.notifiers[QSocketNotifier::Exception] != NULL)
+        event.events |= EPOLLPRI;
+
+    if (event.events == EPOLLET) {
+        ::epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, descriptor, &event);
+
+        return;
+    }
+
+    // Modifying the interest re-arms the edge, readiness already present is reported again
+    if (::epoll_ctl(epollDescriptor, EPOLL_CTL_MOD, descriptor, &event) < 0 && errno == ENOENT)
+        ::epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, descriptor, &event);
+}
+
+int EpollDispatcher::timeUntilNextTimer()
+{
+    if (timers.isEmpty())
+        return -1;
+
+    qint64 now = clock.elapsed(),
+           next = -1;
+
+    QHashIterator<int, Timer> timer(timers);
+    while (timer.hasNext()) {
+        timer.next();
+
+        qint64 remaining = qMax(timer.value().deadline - now, (qint64) 0);
+
+        if (next < 0 || remaining < next)
+            next = remaining;
+    }
+
+    return (int) next;
+}
+
+bool EpollDispatcher::activateTimers()
+{
+    qint64 now = clock.elapsed();
+    QList<int> expired;
+
+    QHashIterator<int, Timer> timer(timers);
+    while (timer.hasNext()) {
+        timer.next();
+
+        if (timer.value().deadline <= now)
+            expired << timer.key();
+    }
+
+    foreach (int timerId, expired) {
+        // A timer may be stopped by the handler of another one
+        if (!timers.contains(timerId))
+            continue;
+
+        Timer &entry = timers[timerId];
+        QObject *object = entry.object;
+
+        entry.deadline = qMax(entry.deadline + entry.interval, now + 1);
+
+        QTimerEvent event(timerId);
+        QCoreApplication::sendEvent(object, &event);
+    }
+
+    return !expired.isEmpty();
+}
+
+bool EpollDispatcher::activateReady()
+{
+    QVector<int> batch = readyList;
+    readyList.clear();
+
+    foreach (int descriptor, batch) {
+        if (descriptor >= descriptors.count())
+            continue;
+
+        descriptors[descriptor].queued = false;
+
+        for (int type = QSocketNotifier::Read; type <= QSocketNotifier::Exception; ++type) {
+            // Handlers may close sockets and grow the table, so the entry is looked up again every time
+            if (!(descriptors[descriptor].ready & (1 << type)))
+                continue;
+
+            QSocketNotifier *notifier = descriptors[descriptor].notifiers[type];
+
+            descriptors[descriptor].ready &= ~(1 << type);
+
+            if (notifier == NULL || !notifier->isEnabled())
+                continue;
+
+            QEvent event(QEvent::SockAct);
+            QCoreApplication::sendEvent(notifier, &event);
+
+            // QAbstractSocket reads everything available, or turns its notifier off and on again, which re-arms the edge.
+            // It writes one block per notification though, and a socket that never filled up raises no new edge.
+            if (type == QSocketNotifier::Write && descriptor < descriptors.count() &&
+                    descriptors[descriptor].notifiers[type] == notifier && notifier->isEnabled())
+                updateInterest(descriptor);
+        }
+    }
+
+    return !batch.isEmpty();
+}
@@ -0,0 +1,67 @@
+#ifndef EPOLLDISPATCHER_H
+#define EPOLLDISPATCHER_H
+
+#include <QAbstractEventDispatcher>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QHash>
+
+// Event dispatcher for worker threads on edge triggered epoll, idle connections cost nothing per wakeup
+class EpollDispatcher : public QAbstractEventDispatcher
+{
+    Q_OBJECT
+
+public:
+    enum {
+        MaxEvents = 256 // ready sockets drained per epoll_wait
+    };
+
+    explicit EpollDispatcher(QObject *parent = 0);
+    ~EpollDispatcher();
+
+    bool processEvents(QEventLoop::ProcessEventsFlags flags);
+    bool hasPendingEvents();
+
+    void registerSocketNotifier(QSocketNotifier *notifier);
+    void unregisterSocketNotifier(QSocketNotifier *notifier);
+
+    void registerTimer(int timerId, int interval, Qt::TimerType timerType, QObject *object);
+    bool unregisterTimer(int timerId);
+    bool unregisterTimers(QObject *object);
+    QList<TimerInfo> registeredTimers(QObject *object) const;
+    int remainingTime(int timerId);
+
+    void wakeUp();
+    void interrupt();
+    void flush();
+
+private:
+    struct Descriptor {
+        QSocketNotifier *notifiers[3]; // indexed by QSocketNotifier::Type
+        quint32 ready; // readiness seen but not yet consumed, bit per notifier type
+        bool queued;
+
+        Descriptor();
+    };
+
+    struct Timer {
+        int interval;
+        Qt::TimerType type;
+        QObject *object;
+        qint64 deadline; // msecs on clock
+    };
+
+    int epollDescriptor, wakeupDescriptor;
+    QAtomicInt interrupted;
+    QElapsedTimer clock;
+    QVector<Descriptor> descriptors; // indexed by file descriptor
+    QVector<int> readyList;
+    QHash<int, Timer> timers; // key: Timer ID
+
+    void updateInterest(int descriptor);
+    int timeUntilNextTimer();
+    bool activateTimers();
+    bool activateReady();
+};
+
+#endif // EPOLLDISPATCHER_H
@@ -0,0 +1,120 @@
+#include "framing.h"
+
+// Attribute names of the XML protocol, indexed by Framing::Field
+static const char *fieldNames[Framing::FieldCount] = {
+    "",
+    "username",
+    "fullname",
+    "group",
+    "handle",
+    "abandoned",
+    "login",
+    "time",
+    "address",
+    "extension",
+    "status",
+    "outbound",
+    "activechannel",
+    "passivechannel",
+    "caller",
+    "callee",
+    "value",
+    "mode",
+    "destination",
+    "customerid",
+    "campaign",
+    "agent",
+    "ready",
+    "window",
+    "message"
+};
+
+void Framing::read(QIODevice *device, QByteArray *buffer)
+{
+    int available = device->bytesAvailable(),
+        size = buffer->size();
+
+    if (available <= 0)
+        return;
+
+    buffer->resize(size + available);
+
+    int received = device->read(buffer->data() + size, available);
+
+    buffer->resize(size + qMax(received, 0));
+}
+
+QByteArray Framing::encode(Framing::Type type, const QByteArray &body)
+{
+    int length = qMin(body.size(), (int) MaxBodyLength);
+
+    QByteArray frame;
+    frame.reserve(HeaderLength + length);
+    frame.append((char) (length >> 8));
+    frame.append((char) (length & 0xff));
+    frame.append((char) type);
+    frame.append(body.constData(), length);
+
+    return frame;
+}
+
+void Framing::appendField(QByteArray *body, Framing::Field field, const QString &value)
+{
+    if (value.isEmpty())
+        return;
+
+    appendField(body, field, value.toUtf8());
+}
+
+void Framing::appendField(QByteArray *body, Framing::Field field, const QByteArray &encoded)
+{
+    if (encoded.isEmpty())
+        return;
+
+    int length = qMin(encoded.size(), (int) MaxFieldLength);
+
+    body->append((char) field);
+    body->append((char) length);
+    body->append(encoded.constData(), length);
+}
+
+int Framing::next(const QByteArray &buffer, int position, Framing::Type *type, const char **body, int *length)
+{
+    if (buffer.size() - position < HeaderLength)
+        return -1;
+
+    const uchar *header = (const uchar *) buffer.constData() + position;
+    int bodyLength = (header[0] << 8) | header[1];
+
+    if (buffer.size() - position - HeaderLength < bodyLength)
+        return -1;
+
+    *type = (Type) header[2];
+    *body = buffer.constData() + position + HeaderLength;
+    *length = bodyLength;
+
+    return position + HeaderLength + bodyLength;
+}
+
+QXmlStreamAttributes Framing::attributes(const char *body, int length)
+{
+    QXmlStreamAttributes attributes;
+    int index = 0;
+
+    while (index + 2 <= length) {
+        uchar field = body[index],
+              fieldLength = body[index + 1];
+
+        index += 2;
+
+        if (index + fieldLength > length)
+            break;
+
+        if (field > 0 && field < FieldCount)
+            attributes.append(QString::fromLatin1(fieldNames[field]), QString::fromUtf8(body + index, fieldLength));
+
+        index += fieldLength;
+    }
+
+    return attributes;
+}
@@ -0,0 +1,77 @@
+#ifndef FRAMING_H
+#define FRAMING_H
+
+#include <QByteArray>
+#include <QString>
+#include <QIODevice>
+#include <QXmlStreamAttributes>
+
+// Length prefixed binary framing, offered at handshake as an alternative to the XML stream:
+// [u16 body length, big endian][u8 type][body], fields in a body are [u8 field][u8 length][value]
+class Framing
+{
+public:
+    enum Type {
+        Beat = 1,
+        Authentication,
+        Action,
+        AgentStatus,
+        AgentLogout,
+        Logout,
+        Xml = 0x7f
+    };
+
+    // First byte of an Action body, fixed on the wire and mapped to Parser elements by the receiver
+    enum Opcode {
+        ReadyOpcode = 5,
+        AskDialAuthorizationOpcode,
+        SpyOpcode,
+        StatusOpcode,
+        StatisticsOpcode
+    };
+
+    enum Field {
+        Username = 1,
+        Fullname,
+        Group,
+        Handle,
+        Abandoned,
+        Login,
+        Time,
+        Address,
+        Extension,
+        PhoneStatus,
+        Outbound,
+        ActiveChannel,
+        PassiveChannel,
+        Caller,
+        Callee,
+        Value,
+        Mode,
+        Destination,
+        CustomerId,
+        Campaign,
+        Agent,
+        Ready,
+        Window,
+        Message,
+        FieldCount
+    };
+
+    enum {
+        HeaderLength = 3,
+        MaxBodyLength = 0xffff,
+        MaxFieldLength = 0xff
+    };
+
+    static void read(QIODevice *device, QByteArray *buffer);
+
+    static QByteArray encode(Type type, const QByteArray &body = QByteArray());
+    static void appendField(QByteArray *body, Field field, const QString &value);
+    static void appendField(QByteArray *body, Field field, const QByteArray &encoded); // already UTF-8
+
+    static int next(const QByteArray &buffer, int position, Type *type, const char **body, int *length);
+    static QXmlStreamAttributes attributes(const char *body, int length);
+};
+
+#endif // FRAMING_H
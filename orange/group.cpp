@@ -1,6 +1,8 @@
 #include <QDebug>
 
 #include "terminal.h"
+#include "metrics.h"
+#include "tracer.h"
 #include "group.h"
 
 Group::Group(QString queue, QObject *parent) :
@@ -22,76 +24,134 @@ void Group::addMember(Client *client)
 
     members.insert(client->getUsername(), client);
 
-    connect(client, SIGNAL(userLoggedOut()), SLOT(onClientUserLoggedOut()));
-    connect(client, SIGNAL(phoneStatusChanged(QString)), SLOT(onClientPhoneStatusChanged(QString)));
-
     broadcastAgentStatus(client);
     retrieveAgentStatuses(client);
 
     qDebug() << "Adding" BOLD BLUE << client->getUsername() << RESET "to group" BOLD BLUE << queue << RESET;
 }
 
-void Group::sendAgentStatus(Client *sender, Client *receiver)
+void Group::removeMember(Client *client)
 {
-    if (receiver != sender && receiver->getLevel() > sender->getLevel()) {
-        receiver->sendAgentStatus(sender->getUsername(),
-                                  sender->getFullname(),
-                                  sender->getPhone(),
-                                  sender->getHandle(),
-                                  sender->getAbandoned(),
-                                  sender->getGroups().first(),
-                                  QDateTime::currentDateTime(),
-                                  sender->getIpAddress(),
-                                  sender->getExtension());
+    if (members.value(client->getUsername()) != client)
+        return;
+
+    members.remove(client->getUsername());
+
+    QHashIterator<QString, Client *> member(members);
+    while (member.hasNext()) {
+        member.next();
+
+        if (member.value()->getLevel() > Client::Agent) {
+            if (member.value()->getLevel() > client->getLevel()) {
+                Client::Delivery delivery;
+                delivery.type = Client::Delivery::AgentLogout;
+                delivery.receiver = member.value();
+                delivery.username = client->getUsernameSymbol();
+                delivery.extension = client->getExtensionSymbol();
+                delivery.group = client->getGroupSymbol();
+                delivery.address = client->getAddressSymbol();
+
+                member.value()->deliver(delivery);
+            }
+        }
     }
 }
 
-void Group::broadcastAgentStatus(Client *client)
+QStringList Group::getMembers()
+{
+    return members.keys();
+}
+
+Statistics::Report Group::collectStatistics(Statistics::Window window)
 {
+    Statistics::Report report;
+
     QHashIterator<QString, Client *> member(members);
     while (member.hasNext()) {
         member.next();
 
-        if (member.value()->getLevel() > Client::Agent)
-            sendAgentStatus(client, member.value());
+        Statistics::Entry entry;
+        entry.username = member.key();
+        entry.counters = member.value()->getStatistics()->collect(window);
+
+        report << entry;
     }
+
+    return report;
 }
 
-void Group::retrieveAgentStatuses(Client *client)
+void Group::broadcastQueueStatus(Queue::Snapshot snapshot)
 {
+    int fanout = 0;
+
     QHashIterator<QString, Client *> member(members);
     while (member.hasNext()) {
         member.next();
 
-        sendAgentStatus(member.value(), client);
+        if (member.value()->getLevel() > Client::Agent) {
+            Client::Delivery delivery;
+            delivery.type = Client::Delivery::QueueStatus;
+            delivery.receiver = member.value();
+            delivery.group = queue;
+            delivery.snapshot = snapshot;
+
+            member.value()->deliver(delivery);
+
+            fanout++;
+        }
+    }
+
+    Metrics::observe(Metrics::FanoutSize, fanout, queue);
+}
+
+bool Group::sendAgentStatus(Client *sender, Client *receiver, quint64 trace)
+{
+    if (receiver != sender && receiver->getLevel() > sender->getLevel()) {
+        Client::Delivery delivery;
+        delivery.type = Client::Delivery::AgentStatus;
+        delivery.receiver = receiver;
+        delivery.username = sender->getUsernameSymbol();
+        delivery.fullname = sender->getFullnameSymbol();
+        delivery.phone = sender->getPhone();
+        delivery.handle = sender->getHandle();
+        delivery.abandoned = sender->getAbandoned();
+        delivery.group = sender->getGroupSymbol();
+        delivery.login = QDateTime::currentDateTime();
+        delivery.address = sender->getAddressSymbol();
+        delivery.extension = sender->getExtensionSymbol();
+        delivery.trace = trace;
+
+        receiver->deliver(delivery);
+
+        return true;
     }
+
+    return false;
 }
 
-void Group::onClientUserLoggedOut()
+void Group::broadcastAgentStatus(Client *client, quint64 trace)
 {
-    Client *client = (Client *) sender();
+    Tracer::Span span(trace, "group.broadcast");
 
-    members.remove(client->getUsername());
+    int fanout = 0;
 
     QHashIterator<QString, Client *> member(members);
     while (member.hasNext()) {
         member.next();
 
-        if (member.value()->getLevel() > Client::Agent) {
-            if (member.value()->getLevel() > client->getLevel()) {
-                member.value()->sendAgentLogout(client->getUsername(),
-                                                client->getExtension(),
-                                                client->getGroups().first(),
-                                                client->getIpAddress());
-            }
-        }
+        if (member.value()->getLevel() > Client::Agent && sendAgentStatus(client, member.value(), trace))
+            fanout++;
     }
+
+    Metrics::observe(Metrics::FanoutSize, fanout, queue);
 }
 
-void Group::onClientPhoneStatusChanged(QString status)
+void Group::retrieveAgentStatuses(Client *client)
 {
-    broadcastAgentStatus((Client *) sender());
+    QHashIterator<QString, Client *> member(members);
+    while (member.hasNext()) {
+        member.next();
 
-    Q_UNUSED(status)
+        sendAgentStatus(member.value(), client);
+    }
 }
-
@@ -14,18 +14,20 @@ public:
     ~Group();
 
     void addMember(Client *client);
+    void removeMember(Client *client);
+
+    QStringList getMembers();
+
+    Statistics::Report collectStatistics(Statistics::Window window);
+    void broadcastAgentStatus(Client *client, quint64 trace = 0);
+    void broadcastQueueStatus(Queue::Snapshot snapshot);
 
 private:
     QString queue;
     QHash<QString, Client *> members; // key: Username
 
-    void sendAgentStatus(Client *sender, Client *receiver);
-    void broadcastAgentStatus(Client *client);
+    bool sendAgentStatus(Client *sender, Client *receiver, quint64 trace = 0);
     void retrieveAgentStatuses(Client *client);
-
-private slots:
-    void onClientUserLoggedOut();
-    void onClientPhoneStatusChanged(QString status);
 };
 
 #endif // GROUP_H
@@ -0,0 +1,75 @@
+#include <QMutex>
+#include <QHash>
+
+#include "groupset.h"
+
+static QMutex idsMutex; // taken once per group name of a login, never by intersections
+static QHash<QString, int> ids;
+
+GroupSet::GroupSet()
+{
+}
+
+void GroupSet::insert(int id)
+{
+    int word = id / 64;
+
+    while (words.count() <= word)
+        words.append(0);
+
+    words[word] |= (quint64) 1 << (id % 64);
+}
+
+bool GroupSet::contains(int id) const
+{
+    int word = id / 64;
+
+    return word < words.count() && (words.at(word) & ((quint64) 1 << (id % 64))) != 0;
+}
+
+bool GroupSet::intersects(const GroupSet &other) const
+{
+    int count = qMin(words.count(), other.words.count());
+
+    for (int i = 0; i < count; ++i) {
+        if ((words.at(i) & other.words.at(i)) != 0)
+            return true;
+    }
+
+    return false;
+}
+
+bool GroupSet::isEmpty() const
+{
+    for (int i = 0; i < words.count(); ++i) {
+        if (words.at(i) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+int GroupSet::idOf(const QString &group)
+{
+    QMutexLocker locker(&idsMutex);
+
+    QHash<QString, int>::const_iterator id = ids.constFind(group);
+
+    if (id != ids.constEnd())
+        return id.value();
+
+    int next = ids.count();
+    ids.insert(group, next);
+
+    return next;
+}
+
+GroupSet GroupSet::fromNames(const QStringList &groups)
+{
+    GroupSet set;
+
+    foreach (const QString &group, groups)
+        set.insert(idOf(group));
+
+    return set;
+}
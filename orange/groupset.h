@@ -0,0 +1,30 @@
+#ifndef GROUPSET_H
+#define GROUPSET_H
+
+#include <QVarLengthArray>
+#include <QStringList>
+
+// Group memberships as a bitset over dense group ids, intersecting two sets is a few word ANDs
+class GroupSet
+{
+public:
+    enum {
+        InlineWords = 4 // the first 256 groups never allocate
+    };
+
+    GroupSet();
+
+    void insert(int id);
+    bool contains(int id) const;
+    bool intersects(const GroupSet &other) const;
+    bool isEmpty() const;
+
+    // Ids are handed out as group names are first seen and kept for the life of the process
+    static int idOf(const QString &group);
+    static GroupSet fromNames(const QStringList &groups);
+
+private:
+    QVarLengthArray<quint64, InlineWords> words;
+};
+
+#endif // GROUPSET_H
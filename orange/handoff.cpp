@@ -0,0 +1,250 @@
+#include <QDebug>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "terminal.h"
+#include "handoff.h"
+
+Handoff::Handoff(int descriptor, int timeout) :
+    descriptor(descriptor),
+    timeout(timeout),
+    owned(false)
+{
+}
+
+Handoff::~Handoff()
+{
+    if (owned && descriptor >= 0)
+        ::close(descriptor);
+}
+
+QByteArray Handoff::greeting()
+{
+    return QByteArray("orange-handoff ") + QByteArray::number(Version);
+}
+
+QByteArray Handoff::encode(const QByteArray &payload)
+{
+    // Every message is [u32 BE length][payload]
+    QByteArray message;
+    message.reserve(4 + payload.size());
+    message.append((char) ((payload.size() >> 24) & 0xff));
+    message.append((char) ((payload.size() >> 16) & 0xff));
+    message.append((char) ((payload.size() >> 8) & 0xff));
+    message.append((char) (payload.size() & 0xff));
+    message.append(payload);
+
+    return message;
+}
+
+bool Handoff::checkPeer(int descriptor)
+{
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+
+    if (::getsockopt(descriptor, SOL_SOCKET, SO_PEERCRED, &credentials, &length) < 0)
+        return false;
+
+    return credentials.uid == ::getuid();
+}
+
+bool Handoff::connectTo(QString path)
+{
+    QByteArray encodedPath = path.toLocal8Bit();
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (encodedPath.size() >= (int) sizeof(address.sun_path))
+        return false;
+
+    memcpy(address.sun_path, encodedPath.constData(), encodedPath.size());
+
+    int socketDescriptor = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (socketDescriptor < 0)
+        return false;
+
+    if (::connect(socketDescriptor, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        ::close(socketDescriptor);
+
+        return false;
+    }
+
+    if (!checkPeer(socketDescriptor)) {
+        qWarning() << "Handoff socket" BOLD BLUE << path << RESET "belongs to another user, ignored";
+
+        ::close(socketDescriptor);
+
+        return false;
+    }
+
+    // Every wait is bounded by the timeout, a wedged peer must not hang the startup
+    ::fcntl(socketDescriptor, F_SETFL, ::fcntl(socketDescriptor, F_GETFL) | O_NONBLOCK);
+
+    descriptor = socketDescriptor;
+    owned = true;
+
+    return true;
+}
+
+bool Handoff::send(const QByteArray &payload, int descriptor)
+{
+    // The descriptor rides along with the first byte
+    QByteArray message = encode(payload);
+
+    int sent = 0;
+
+    while (sent < message.size()) {
+        struct iovec vector;
+        vector.iov_base = (void *) (message.constData() + sent);
+        vector.iov_len = message.size() - sent;
+
+        char control[CMSG_SPACE(sizeof(int))];
+        memset(control, 0, sizeof(control));
+
+        struct msghdr header;
+        memset(&header, 0, sizeof(header));
+        header.msg_iov = &vector;
+        header.msg_iovlen = 1;
+
+        if (sent == 0 && descriptor >= 0) {
+            header.msg_control = control;
+            header.msg_controllen = sizeof(control);
+
+            struct cmsghdr *controlHeader = CMSG_FIRSTHDR(&header);
+            controlHeader->cmsg_level = SOL_SOCKET;
+            controlHeader->cmsg_type = SCM_RIGHTS;
+            controlHeader->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(controlHeader), &descriptor, sizeof(int));
+        }
+
+        ssize_t written = ::sendmsg(this->descriptor, &header, MSG_NOSIGNAL);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitFor(POLLOUT))
+                continue;
+
+            qWarning() << "Handoff send failed:" BOLD CYAN << strerror(errno) << RESET;
+
+            return false;
+        }
+
+        sent += written;
+    }
+
+    return true;
+}
+
+bool Handoff::receive(QByteArray *payload, int *descriptor)
+{
+    *descriptor = -1;
+
+    uchar length[4];
+    int received = 0;
+
+    // The descriptor, if any, arrives with the first byte of the length prefix
+    while (received == 0) {
+        struct iovec vector;
+        vector.iov_base = length;
+        vector.iov_len = sizeof(length);
+
+        char control[CMSG_SPACE(sizeof(int))];
+
+        struct msghdr header;
+        memset(&header, 0, sizeof(header));
+        header.msg_iov = &vector;
+        header.msg_iovlen = 1;
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+
+        ssize_t read = ::recvmsg(this->descriptor, &header, 0);
+
+        if (read < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitFor(POLLIN))
+                continue;
+
+            return false;
+        }
+
+        if (read == 0)
+            return false;
+
+        struct cmsghdr *controlHeader = CMSG_FIRSTHDR(&header);
+
+        if (controlHeader != NULL && controlHeader->cmsg_level == SOL_SOCKET && controlHeader->cmsg_type == SCM_RIGHTS)
+            memcpy(descriptor, CMSG_DATA(controlHeader), sizeof(int));
+
+        received = read;
+    }
+
+    bool succeed = readFully((char *) length, sizeof(length), &received);
+
+    if (succeed) {
+        int size = (length[0] << 24) | (length[1] << 16) | (length[2] << 8) | length[3];
+
+        if (size >= 0 && size <= MaxPayloadLength) {
+            payload->resize(size);
+            received = 0;
+
+            succeed = readFully(payload->data(), size, &received);
+        } else {
+            succeed = false;
+        }
+    }
+
+    if (!succeed && *descriptor >= 0) {
+        ::close(*descriptor);
+
+        *descriptor = -1;
+    }
+
+    return succeed;
+}
+
+bool Handoff::waitFor(short events)
+{
+    struct pollfd target;
+    target.fd = descriptor;
+    target.events = events;
+    target.revents = 0;
+
+    return ::poll(&target, 1, timeout) > 0;
+}
+
+bool Handoff::readFully(char *data, int length, int *received)
+{
+    while (*received < length) {
+        ssize_t read = ::read(descriptor, data + *received, length - *received);
+
+        if (read < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitFor(POLLIN))
+                continue;
+
+            return false;
+        }
+
+        if (read == 0)
+            return false;
+
+        *received += read;
+    }
+
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <QString>
+#include <QByteArray>
+
+// Blocking message channel over a Unix stream socket, each message may carry one file descriptor (SCM_RIGHTS)
+class Handoff
+{
+public:
+    enum {
+        MaxPayloadLength = 16777216,
+        Version = 1 // raised whenever the messages change, processes only hand off to their own version
+    };
+
+    explicit Handoff(int descriptor = -1, int timeout = 5000);
+    ~Handoff();
+
+    // First message of the new process, the old one hands nothing over before it
+    static QByteArray greeting();
+    static QByteArray encode(const QByteArray &payload);
+
+    // Only a peer running as our own user may take over or hand over the server
+    static bool checkPeer(int descriptor);
+
+    bool connectTo(QString path);
+
+    bool send(const QByteArray &payload, int descriptor = -1);
+    bool receive(QByteArray *payload, int *descriptor);
+
+private:
+    int descriptor, timeout;
+    bool owned;
+
+    bool waitFor(short events);
+    bool readFully(char *data, int length, int *received);
+};
+
+#endif // HANDOFF_H
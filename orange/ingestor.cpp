@@ -0,0 +1,462 @@
+#include <QSqlDatabase>
+#include <QSqlDriver>
+#include <QSqlError>
+#include <QDateTime>
+#include <QDebug>
+
+#include <libpq-fe.h>
+
+#include "terminal.h"
+#include "metrics.h"
+#include "ingestor.h"
+
+static const char *tableNames[Ingestor::TableCount] = {
+    "acd_log_cdr",
+    "acd_log_queue"
+};
+
+static const char *tableColumns[Ingestor::TableCount] = {
+    "uniqueid, source, destination, destination_context, caller_id, channel, destination_channel, "
+    "last_application, start_time, answer_time, end_time, duration, billable_seconds, disposition, "
+    "account_code, user_field",
+    "uniqueid, event, queue, channel, member, position, hold_time, talk_time, reason, event_time"
+};
+
+static PGconn *pgConnection(QSqlDatabase database)
+{
+    QVariant handle = database.driver()->handle();
+
+    if (handle.isValid() && qstrcmp(handle.typeName(), "PGconn*") == 0)
+        return *static_cast<PGconn **>(handle.data());
+
+    return NULL;
+}
+
+// Data exceptions (class 22) and integrity violations (class 23) come from the rows, retrying them never helps
+static bool pgRefused(PGresult *result)
+{
+    const char *state = PQresultErrorField(result, PG_DIAG_SQLSTATE);
+
+    return state != NULL && state[0] == '2' && (state[1] == '2' || state[1] == '3');
+}
+
+static bool pgExecute(PGconn *connection, QByteArray command, ExecStatusType expected = PGRES_COMMAND_OK, bool *refused = NULL)
+{
+    PGresult *result = PQexec(connection, command.constData());
+    bool succeed = PQresultStatus(result) == expected;
+
+    if (!succeed)
+        qCritical() << "Ingestion command failed, error:" BOLD CYAN << PQerrorMessage(connection) << RESET;
+
+    if (!succeed && refused != NULL)
+        *refused = pgRefused(result);
+
+    PQclear(result);
+
+    return succeed;
+}
+
+Ingestor::Ingestor(Database database, QString spoolPath, QString deadLetterPath, int capacity, int batchSize, int flushInterval) :
+    QThread(),
+    database(database),
+    connectionName("ingestor"),
+    spool(spoolPath),
+    deadLetter(deadLetterPath),
+    replayOffset(0),
+    capacity(qMax(capacity, batchSize)),
+    batchSize(batchSize),
+    flushInterval(flushInterval),
+    stopping(false)
+{
+    if (!spool.open(QIODevice::ReadWrite | QIODevice::Append | QIODevice::Unbuffered))
+        qWarning() << "Ingestion spool" BOLD BLUE << spoolPath << RESET "could not be opened, overflowing rows will be lost";
+
+    if (!deadLetter.open(QIODevice::WriteOnly | QIODevice::Append))
+        qWarning() << "Ingestion dead letter file" BOLD BLUE << deadLetterPath << RESET "could not be opened, refused rows will be lost";
+
+    qDebug("Ingestor initialized");
+}
+
+Ingestor::~Ingestor()
+{
+    spool.close();
+    deadLetter.close();
+
+    qDebug("Ingestor destroyed");
+}
+
+bool Ingestor::accepts(QString event)
+{
+    return event == "Cdr" || event == "QueueCallerJoin" || event == "AgentComplete";
+}
+
+void Ingestor::enqueue(QString event, QVariantHash headers)
+{
+    Row row;
+    row.spoolEnd = 0;
+
+    if (event == "Cdr") {
+        row.table = Cdr;
+        row.line = encodeRow(QList<QVariant>() << headers.value("UniqueID")
+                                               << headers.value("Source")
+                                               << headers.value("Destination")
+                                               << headers.value("DestinationContext")
+                                               << headers.value("CallerID")
+                                               << headers.value("Channel")
+                                               << headers.value("DestinationChannel")
+                                               << headers.value("LastApplication")
+                                               << headers.value("StartTime")
+                                               << headers.value("AnswerTime")
+                                               << headers.value("EndTime")
+                                               << headers.value("Duration")
+                                               << headers.value("BillableSeconds")
+                                               << headers.value("Disposition")
+                                               << headers.value("AccountCode")
+                                               << headers.value("UserField"));
+    } else {
+        QVariant member = headers.contains("MemberName") ? headers.value("MemberName") : headers.value("Interface");
+
+        row.table = QueueLog;
+        row.line = encodeRow(QList<QVariant>() << headers.value("Uniqueid")
+                                               << event
+                                               << headers.value("Queue")
+                                               << headers.value("Channel")
+                                               << member
+                                               << headers.value("Position")
+                                               << headers.value("HoldTime")
+                                               << headers.value("TalkTime")
+                                               << headers.value("Reason")
+                                               << QDateTime::currentDateTime().toString("yyyy-MM-dd HH:mm:ss.zzz"));
+    }
+
+    QMutexLocker locker(&mutex);
+
+    // Once rows overflow to the spool, newer rows follow them there until the spool has been replayed
+    if (rows.count() >= capacity || spool.size() > 0)
+        spill(row);
+    else
+        rows.enqueue(row);
+
+    if (rows.count() >= batchSize)
+        condition.wakeOne();
+}
+
+void Ingestor::setBatching(int batchSize, int flushInterval)
+{
+    QMutexLocker locker(&mutex);
+
+    this->batchSize = qMax(batchSize, 1);
+    this->flushInterval = qMax(flushInterval, 1);
+    capacity = qMax(capacity, this->batchSize);
+
+    // The writer may be sleeping on the old interval
+    condition.wakeOne();
+}
+
+void Ingestor::stop()
+{
+    QMutexLocker locker(&mutex);
+
+    stopping = true;
+
+    condition.wakeOne();
+}
+
+void Ingestor::run()
+{
+    qDebug() << "Ingestor running on thread:" BOLD BLUE << currentThreadId() << RESET;
+
+    forever {
+        QList<Row> batch;
+
+        mutex.lock();
+
+        if (rows.isEmpty())
+            replaySpool();
+
+        if (rows.count() < batchSize && !stopping) {
+            condition.wait(&mutex, flushInterval);
+
+            if (rows.isEmpty())
+                replaySpool();
+        }
+
+        bool finished = stopping;
+
+        batch = rows.mid(0, batchSize);
+
+        mutex.unlock();
+
+        if (batch.isEmpty()) {
+            if (finished)
+                break;
+
+            continue;
+        }
+
+        // Rows leave the queue only after their transaction committed, the rest is retried once the database is back
+        int delivered = openConnection() ? deliver(batch) : 0;
+
+        if (delivered > 0) {
+            QMutexLocker locker(&mutex);
+
+            dequeue(delivered);
+        }
+
+        if (delivered < batch.count()) {
+            QSqlDatabase::database(connectionName, false).close();
+
+            if (finished)
+                break;
+
+            sleep(5);
+        }
+    }
+
+    QMutexLocker locker(&mutex);
+
+    // Rows read back from the spool are still in it
+    while (!rows.isEmpty()) {
+        Row row = rows.dequeue();
+
+        if (row.spoolEnd == 0)
+            spill(row);
+    }
+
+    QSqlDatabase::database(connectionName, false).close();
+
+    qDebug("Ingestor finished");
+}
+
+QByteArray Ingestor::encodeField(QVariant value)
+{
+    QString text = value.toString();
+
+    if (text.isEmpty())
+        return "\\N";
+
+    QByteArray field = text.toUtf8();
+    field.replace('\\', "\\\\");
+    field.replace('\t', "\\t");
+    field.replace('\n', "\\n");
+    field.replace('\r', "\\r");
+
+    return field;
+}
+
+QByteArray Ingestor::encodeRow(QList<QVariant> fields)
+{
+    QByteArray line;
+
+    for (int i = 0; i < fields.count(); ++i) {
+        if (i > 0)
+            line.append('\t');
+
+        line.append(encodeField(fields.at(i)));
+    }
+
+    line.append('\n');
+
+    return line;
+}
+
+void Ingestor::spill(const Ingestor::Row &row)
+{
+    if (!spool.isOpen())
+        return;
+
+    spool.write(QByteArray::number((int) row.table) + '\t' + row.line);
+}
+
+void Ingestor::replaySpool()
+{
+    if (!spool.isOpen() || spool.size() <= replayOffset)
+        return;
+
+    spool.seek(replayOffset);
+
+    while (rows.count() < capacity && !spool.atEnd()) {
+        QByteArray line = spool.readLine();
+        int separator = line.indexOf('\t');
+
+        replayOffset += line.size();
+
+        if (separator <= 0 || !line.endsWith('\n'))
+            continue;
+
+        Row row;
+        row.table = (Table) line.left(separator).toInt();
+        row.line = line.mid(separator + 1);
+        row.spoolEnd = replayOffset;
+
+        rows.enqueue(row);
+    }
+}
+
+void Ingestor::dequeue(int count)
+{
+    qint64 delivered = 0;
+
+    for (int i = 0; i < count; ++i)
+        delivered = qMax(delivered, rows.dequeue().spoolEnd);
+
+    // The spool is emptied once the last row it holds has been delivered, a crash before that replays it again
+    if (delivered > 0 && delivered >= spool.size()) {
+        spool.resize(0);
+        replayOffset = 0;
+    }
+}
+
+bool Ingestor::openConnection()
+{
+    if (!QSqlDatabase::contains(connectionName)) {
+        QSqlDatabase connection = QSqlDatabase::addDatabase("QPSQL", connectionName);
+        connection.setHostName(database.host);
+        connection.setPort(database.port);
+        connection.setDatabaseName(database.name);
+        connection.setUserName(database.username);
+
+        if (!database.password.isEmpty())
+            connection.setPassword(database.password);
+    }
+
+    QSqlDatabase connection = QSqlDatabase::database(connectionName, false);
+
+    if (connection.isOpen())
+        return true;
+
+    if (!connection.open()) {
+        qWarning() << "Ingestion database connection failed:" BOLD CYAN << connection.lastError() << RESET;
+
+        return false;
+    }
+
+    PGconn *pg = pgConnection(connection);
+
+    if (pg == NULL)
+        return false;
+
+    // Batches land in session local staging tables first, the final insert skips rows already delivered
+    for (int table = 0; table < TableCount; ++table) {
+        QByteArray command = QString("CREATE TEMP TABLE IF NOT EXISTS tmp_%1 (LIKE %1 INCLUDING DEFAULTS) ON COMMIT DELETE ROWS")
+                .arg(tableNames[table]).toLatin1();
+
+        if (!pgExecute(pg, command)) {
+            connection.close();
+
+            return false;
+        }
+    }
+
+    qDebug("Ingestor connected to database");
+
+    return true;
+}
+
+int Ingestor::deliver(QList<Ingestor::Row> batch)
+{
+    bool refused = false;
+
+    if (copyBatch(batch, &refused))
+        return batch.count();
+
+    // Lost connections and server trouble are retried later, only rows the database refused are set aside
+    if (!refused)
+        return 0;
+
+    if (batch.count() == 1) {
+        const Row &row = batch.first();
+
+        qCritical() << "Ingestion row refused, moved to dead letter file:" BOLD CYAN << row.line.trimmed() << RESET;
+
+        if (deadLetter.isOpen()) {
+            deadLetter.write(QByteArray::number((int) row.table) + '\t' + row.line);
+            deadLetter.flush();
+        }
+
+        return 1;
+    }
+
+    // Halving isolates the refused rows in a logarithmic number of transactions
+    int half = batch.count() / 2,
+        delivered = deliver(batch.mid(0, half));
+
+    if (delivered < half)
+        return delivered;
+
+    return half + deliver(batch.mid(half));
+}
+
+bool Ingestor::copyBatch(QList<Ingestor::Row> batch, bool *refused)
+{
+    QSqlDatabase connection = QSqlDatabase::database(connectionName, false);
+    PGconn *pg = pgConnection(connection);
+
+    if (pg == NULL)
+        return false;
+
+    qint64 start = Metrics::now();
+
+    if (!pgExecute(pg, "BEGIN"))
+        return false;
+
+    for (int table = 0; table < TableCount; ++table) {
+        QList<const Row *> tableRows;
+
+        foreach (const Row &row, batch) {
+            if (row.table == table)
+                tableRows << &row;
+        }
+
+        if (tableRows.isEmpty())
+            continue;
+
+        QByteArray copy = QString("COPY tmp_%1 (%2) FROM STDIN").arg(tableNames[table], tableColumns[table]).toLatin1();
+
+        if (!pgExecute(pg, copy, PGRES_COPY_IN)) {
+            pgExecute(pg, "ROLLBACK");
+
+            return false;
+        }
+
+        bool succeed = true;
+
+        foreach (const Row *row, tableRows) {
+            if (PQputCopyData(pg, row->line.constData(), row->line.size()) != 1) {
+                succeed = false;
+
+                break;
+            }
+        }
+
+        PQputCopyEnd(pg, succeed ? NULL : "aborted");
+
+        PGresult *result;
+        while ((result = PQgetResult(pg)) != NULL) {
+            if (PQresultStatus(result) != PGRES_COMMAND_OK) {
+                succeed = false;
+                *refused = pgRefused(result);
+            }
+
+            PQclear(result);
+        }
+
+        QByteArray insert = QString("INSERT INTO %1 (%2) SELECT %2 FROM tmp_%1 ON CONFLICT DO NOTHING")
+                .arg(tableNames[table], tableColumns[table]).toLatin1();
+
+        if (!succeed || !pgExecute(pg, insert, PGRES_COMMAND_OK, refused)) {
+            qCritical() << "Ingestion COPY into" BOLD BLUE << tableNames[table] << RESET "failed:" BOLD CYAN << PQerrorMessage(pg) << RESET;
+
+            pgExecute(pg, "ROLLBACK");
+
+            return false;
+        }
+    }
+
+    // Deferred constraints are only checked here
+    bool committed = pgExecute(pg, "COMMIT", PGRES_COMMAND_OK, refused);
+
+    Metrics::observe(Metrics::DatabaseQueryDuration, Metrics::now() - start, "ingest_batch");
+
+    return committed;
+}
@@ -0,0 +1,68 @@
+#ifndef INGESTOR_H
+#define INGESTOR_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QFile>
+#include <QVariantHash>
+
+class Ingestor : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum Table {
+        Cdr,
+        QueueLog,
+        TableCount
+    };
+
+    struct Database {
+        QString host, name, username, password;
+        int port;
+    };
+
+    Ingestor(Database database, QString spoolPath, QString deadLetterPath, int capacity = 20000, int batchSize = 500, int flushInterval = 1000);
+    ~Ingestor();
+
+    static bool accepts(QString event);
+
+    void enqueue(QString event, QVariantHash headers);
+    void setBatching(int batchSize, int flushInterval);
+    void stop();
+
+    void run();
+
+private:
+    struct Row {
+        Table table;
+        QByteArray line; // COPY text format, newline terminated
+        qint64 spoolEnd; // offset right after the row in the spool, 0 when it was never spilled
+    };
+
+    Database database;
+    QString connectionName;
+    QMutex mutex;
+    QWaitCondition condition;
+    QQueue<Row> rows;
+    QFile spool;
+    QFile deadLetter; // rows the database keeps refusing, in the spool format
+    qint64 replayOffset;
+    int capacity, batchSize, flushInterval;
+    bool stopping;
+
+    static QByteArray encodeField(QVariant value);
+    static QByteArray encodeRow(QList<QVariant> fields);
+
+    void spill(const Row &row);
+    void replaySpool();
+    void dequeue(int count);
+
+    bool openConnection();
+    int deliver(QList<Row> batch);
+    bool copyBatch(QList<Row> batch, bool *refused);
+};
+
+#endif // INGESTOR_H
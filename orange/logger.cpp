@@ -0,0 +1,246 @@
+#include <QDateTime>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+
+#include "terminal.h"
+#include "logger.h"
+
+// Indexed by Logger::Level
+static const char *levelNames[] = {
+    GREEN "INFO",
+    YELLOW "WARNING",
+    RED "CRITICAL",
+    BOLD RED "FATAL"
+};
+
+static const char *plainLevelNames[] = {
+    "INFO",
+    "WARNING",
+    "CRITICAL",
+    "FATAL"
+};
+
+Logger::Logger() :
+    QThread(),
+    running(1),
+    minimumLevel(Info),
+    descriptor(STDOUT_FILENO),
+    colored(isatty(STDOUT_FILENO)),
+    second(-1)
+{
+}
+
+Logger::~Logger()
+{
+    stop();
+}
+
+Logger *Logger::instance()
+{
+    static Logger logger;
+
+    return &logger;
+}
+
+void Logger::handler(QtMsgType type, const char *message)
+{
+    Logger *logger = instance();
+    Level level = levelOf(type);
+
+    if (level < logger->minimumLevel.load())
+        return;
+
+    logger->append(level, message);
+
+    // Nothing may be lost before an abort, and without the writer nobody else would drain
+    if (level == Fatal || logger->running.load() == 0)
+        logger->flush();
+    else if (level == Critical)
+        logger->condition.wakeOne();
+}
+
+void Logger::configure(Logger::Level level, QString path)
+{
+    QMutexLocker locker(&mutex);
+
+    minimumLevel.store(level);
+
+    if (path.isEmpty())
+        return;
+
+    int file = ::open(path.toLocal8Bit().constData(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (file < 0) {
+        batch.append("Log file could not be opened: ").append(path.toLocal8Bit()).append(": ").append(strerror(errno)).append('\n');
+        writeBatch();
+
+        return;
+    }
+
+    if (descriptor != STDOUT_FILENO)
+        ::close(descriptor);
+
+    descriptor = file;
+    colored = false;
+}
+
+void Logger::stop()
+{
+    if (running.fetchAndStoreOrdered(0) == 0)
+        return;
+
+    condition.wakeOne();
+    wait();
+
+    flush();
+}
+
+void Logger::flush()
+{
+    QMutexLocker locker(&mutex);
+
+    drain();
+}
+
+Logger::Level Logger::levelFromText(QString text)
+{
+    if (text == "warning")
+        return Warning;
+    else if (text == "critical")
+        return Critical;
+
+    return Info;
+}
+
+void Logger::run()
+{
+    QMutexLocker locker(&mutex);
+
+    while (running.load() != 0) {
+        condition.wait(&mutex, FlushInterval);
+
+        drain();
+    }
+}
+
+void Logger::append(Logger::Level level, const char *message)
+{
+    Ring *ring = rings.local();
+    int tail = ring->tail.load(),
+        next = (tail + 1) % Capacity;
+
+    // A full ring drops the line rather than blocking the thread that logs
+    if (next == ring->head.loadAcquire()) {
+        ring->dropped.fetchAndAddRelaxed(1);
+
+        return;
+    }
+
+    Record &record = ring->records[tail];
+    record.time = QDateTime::currentMSecsSinceEpoch();
+    record.level = level;
+    record.length = qMin((int) strlen(message), (int) TextLength);
+
+    memcpy(record.text, message, record.length);
+
+    ring->tail.storeRelease(next);
+}
+
+void Logger::drain()
+{
+    foreach (Ring *ring, rings.all()) {
+        int head = ring->head.load(),
+            tail = ring->tail.loadAcquire();
+
+        while (head != tail) {
+            format(ring->records[head]);
+
+            head = (head + 1) % Capacity;
+        }
+
+        ring->head.storeRelease(head);
+
+        int dropped = ring->dropped.fetchAndStoreRelaxed(0);
+
+        if (dropped > 0)
+            batch.append("Log ring full, messages dropped: ").append(QByteArray::number(dropped)).append('\n');
+    }
+
+    writeBatch();
+}
+
+void Logger::format(const Logger::Record &record)
+{
+    // The date part changes once a second, it is formatted only then
+    if (record.time / 1000 != second) {
+        second = record.time / 1000;
+        secondText = QDateTime::fromMSecsSinceEpoch(second * 1000).toString("yyyy-MM-dd hh:mm:ss").toLatin1();
+    }
+
+    char milliseconds[8];
+    snprintf(milliseconds, sizeof(milliseconds), ":%03d", (int) (record.time % 1000));
+
+    batch.append(secondText).append(milliseconds).append(" [");
+
+    if (colored)
+        batch.append(levelNames[record.level]).append(RESET);
+    else
+        batch.append(plainLevelNames[record.level]);
+
+    batch.append("] ");
+
+    // Quotes added by QDebug are left out, as are the surrounding blanks
+    int start = 0,
+        end = record.length;
+
+    while (start < end && isspace((uchar) record.text[start]))
+        start++;
+
+    while (end > start && isspace((uchar) record.text[end - 1]))
+        end--;
+
+    for (int i = start; i < end; ++i) {
+        if (record.text[i] != '"')
+            batch.append(record.text[i]);
+    }
+
+    batch.append('\n');
+}
+
+void Logger::writeBatch()
+{
+    int written = 0;
+
+    while (written < batch.size()) {
+        int result = ::write(descriptor, batch.constData() + written, batch.size() - written);
+
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        if (result <= 0)
+            break;
+
+        written += result;
+    }
+
+    batch.resize(0);
+}
+
+Logger::Level Logger::levelOf(QtMsgType type)
+{
+    switch (type) {
+    case QtWarningMsg:
+        return Warning;
+    case QtCriticalMsg:
+        return Critical;
+    case QtFatalMsg:
+        return Fatal;
+    default:
+        return Info;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QList>
+
+#include "perthread.h"
+
+// Message handler queueing lines into per-thread rings, a background thread formats and writes them in batches
+class Logger : public QThread
+{
+public:
+    enum Level {
+        Info,
+        Warning,
+        Critical,
+        Fatal
+    };
+
+    enum {
+        Capacity = 1024, // records per thread, one is always kept free
+        TextLength = 240, // longer messages are truncated
+        FlushInterval = 50 // msecs
+    };
+
+    static Logger *instance();
+    static void handler(QtMsgType type, const char *message);
+
+    void configure(Level level, QString path = QString());
+    void stop();
+    void flush();
+
+    static Level levelFromText(QString text);
+
+protected:
+    void run();
+
+private:
+    struct Record {
+        qint64 time; // msecs since epoch
+        int level, length;
+        char text[TextLength];
+    };
+
+    // Single producer, the owning thread, and single consumer, the writer
+    struct Ring {
+        QAtomicInt head, tail, dropped;
+        Record records[Capacity];
+    };
+
+    QMutex mutex; // held by whoever drains, never by the threads logging
+    QWaitCondition condition;
+    PerThread<Ring> rings; // handed on to a new thread once the one logging into it exits
+    QAtomicInt running, minimumLevel;
+    int descriptor;
+    bool colored;
+    QByteArray batch, secondText;
+    qint64 second;
+
+    Logger();
+    ~Logger();
+
+    void append(Level level, const char *message);
+    void drain();
+    void format(const Record &record);
+    void writeBatch();
+
+    static Level levelOf(QtMsgType type);
+};
+
+#endif // LOGGER_H
@@ -0,0 +1,209 @@
+#include <QSqlQuery>
+#include <QStringList>
+#include <QList>
+#include <QMap>
+
+#include <time.h>
+
+#include "metrics.h"
+
+enum Type {
+    Counter,
+    Gauge,
+    Histogram
+};
+
+struct Definition {
+    const char *name, *help;
+    Type type;
+    const char *labelName;
+    const qint64 *bounds;
+    int boundCount;
+    double scale; // recorded unit to exposed unit
+};
+
+static const qint64 durationBounds[] = {100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000};
+static const qint64 sizeBounds[] = {1, 2, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000};
+
+// Indexed by Metrics::Metric
+static const Definition definitions[] = {
+    {"orange_worker_connections", "Client connections handled by each worker thread.", Gauge, "worker", NULL, 0, 1},
+    {"orange_logins_total", "Successful agent logins.", Counter, NULL, NULL, 0, 1},
+    {"orange_ami_action_duration_seconds", "Round trip time of AMI actions until their response.", Histogram, "action", durationBounds, 16, 0.000001},
+    {"orange_ami_events_total", "Events received from the Asterisk Manager Interface.", Counter, NULL, NULL, 0, 1},
+    {"orange_database_query_duration_seconds", "Execution time of database statements.", Histogram, "statement", durationBounds, 16, 0.000001},
+    {"orange_group_fanout_size", "Deliveries queued by a single group broadcast.", Histogram, "group", sizeBounds, 12, 1},
+    {"orange_group_delivery_latency_seconds", "Time from a group broadcast until the receiving worker handled the delivery.", Histogram, "group", durationBounds, 16, 0.000001},
+    {"orange_client_output_queue_bytes", "Bytes waiting in the output buffer of each client socket.", Gauge, "client", NULL, 0, 1}
+};
+
+PerThread<Metrics::Shard> Metrics::shards; // counters of a thread that exits stay in its shard for the next one
+
+bool Metrics::Key::operator==(const Metrics::Key &other) const
+{
+    return metric == other.metric && label == other.label;
+}
+
+uint qHash(const Metrics::Key &key)
+{
+    return qHash(key.label) ^ (uint) key.metric;
+}
+
+Metrics::Value::Value() :
+    value(0),
+    sum(0),
+    count(0)
+{
+    for (int i = 0; i < MaxBuckets; ++i)
+        buckets[i] = 0;
+}
+
+void Metrics::Value::merge(const Metrics::Value &other)
+{
+    value += other.value;
+    sum += other.sum;
+    count += other.count;
+
+    for (int i = 0; i < MaxBuckets; ++i)
+        buckets[i] += other.buckets[i];
+}
+
+void Metrics::add(Metrics::Metric metric, qint64 value, const QString &label)
+{
+    Shard *shard = shards.local();
+    Key key = {metric, label};
+
+    QMutexLocker locker(&shard->mutex);
+    shard->values[key].value += value;
+}
+
+void Metrics::set(Metrics::Metric metric, qint64 value, const QString &label)
+{
+    Shard *shard = shards.local();
+    Key key = {metric, label};
+
+    QMutexLocker locker(&shard->mutex);
+    shard->values[key].value = value;
+}
+
+void Metrics::remove(Metrics::Metric metric, const QString &label)
+{
+    Shard *shard = shards.local();
+    Key key = {metric, label};
+
+    QMutexLocker locker(&shard->mutex);
+    shard->values.remove(key);
+}
+
+void Metrics::observe(Metrics::Metric metric, qint64 value, const QString &label)
+{
+    Shard *shard = shards.local();
+    Key key = {metric, label};
+    const Definition &definition = definitions[metric];
+
+    // Buckets are stored non-cumulative, the exposition adds them up
+    int bucket = 0;
+
+    while (bucket < definition.boundCount && value > definition.bounds[bucket])
+        bucket++;
+
+    QMutexLocker locker(&shard->mutex);
+    Value &entry = shard->values[key];
+    entry.sum += value;
+    entry.count++;
+
+    if (bucket < definition.boundCount)
+        entry.buckets[bucket]++;
+}
+
+qint64 Metrics::now()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (qint64) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+bool Metrics::exec(QSqlQuery *query, const QString &statement)
+{
+    qint64 start = now();
+    bool succeed = query->exec();
+
+    observe(DatabaseQueryDuration, now() - start, statement);
+
+    return succeed;
+}
+
+QByteArray Metrics::exposition()
+{
+    QMap<QString, Value> merged[MetricCount]; // sorted by label, for a stable output
+
+    foreach (Shard *shard, shards.all()) {
+        QMutexLocker locker(&shard->mutex);
+
+        QHashIterator<Key, Value> entry(shard->values);
+        while (entry.hasNext()) {
+            entry.next();
+
+            merged[entry.key().metric][entry.key().label].merge(entry.value());
+        }
+    }
+
+    QByteArray text;
+
+    for (int metric = 0; metric < MetricCount; ++metric) {
+        const Definition &definition = definitions[metric];
+
+        text.append("# HELP ").append(definition.name).append(' ').append(definition.help).append('\n');
+        text.append("# TYPE ").append(definition.name).append(' ')
+            .append(definition.type == Counter ? "counter" : definition.type == Gauge ? "gauge" : "histogram").append('\n');
+
+        QMapIterator<QString, Value> entry(merged[metric]);
+        while (entry.hasNext()) {
+            entry.next();
+
+            QByteArray label;
+
+            if (definition.labelName != NULL) {
+                QString value = entry.key();
+                value.replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n");
+
+                label = QByteArray(definition.labelName) + "=\"" + value.toUtf8() + "\"";
+            }
+
+            if (definition.type != Histogram) {
+                text.append(definition.name);
+
+                if (!label.isEmpty())
+                    text.append('{').append(label).append('}');
+
+                text.append(' ').append(QByteArray::number(entry.value().value)).append('\n');
+
+                continue;
+            }
+
+            QByteArray separator = label.isEmpty() ? "" : ",";
+            qint64 cumulative = 0;
+
+            for (int i = 0; i < definition.boundCount; ++i) {
+                cumulative += entry.value().buckets[i];
+
+                text.append(definition.name).append("_bucket{").append(label).append(separator)
+                    .append("le=\"").append(QByteArray::number(definition.bounds[i] * definition.scale)).append("\"} ")
+                    .append(QByteArray::number(cumulative)).append('\n');
+            }
+
+            text.append(definition.name).append("_bucket{").append(label).append(separator)
+                .append("le=\"+Inf\"} ").append(QByteArray::number(entry.value().count)).append('\n');
+
+            QByteArray braces = label.isEmpty() ? QByteArray() : "{" + label + "}";
+
+            text.append(definition.name).append("_sum").append(braces).append(' ')
+                .append(QByteArray::number(entry.value().sum * definition.scale)).append('\n');
+            text.append(definition.name).append("_count").append(braces).append(' ')
+                .append(QByteArray::number(entry.value().count)).append('\n');
+        }
+    }
+
+    return text;
+}
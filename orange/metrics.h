@@ -0,0 +1,75 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QMutex>
+#include <QHash>
+#include <QString>
+#include <QByteArray>
+
+#include "perthread.h"
+
+class QSqlQuery;
+
+// Counters, gauges and histograms kept in per-thread shards, merged only when scraped
+class Metrics
+{
+public:
+    enum Metric {
+        WorkerConnections,
+        Logins,
+        AsteriskActionDuration,
+        AsteriskEvents,
+        DatabaseQueryDuration,
+        FanoutSize,
+        DeliveryLatency,
+        ClientOutputQueue,
+        MetricCount
+    };
+
+    enum {
+        MaxBuckets = 16
+    };
+
+    struct Key {
+        int metric;
+        QString label;
+
+        bool operator==(const Key &other) const;
+    };
+
+    static void add(Metric metric, qint64 value = 1, const QString &label = QString());
+    static void set(Metric metric, qint64 value, const QString &label = QString());
+    static void remove(Metric metric, const QString &label);
+    static void observe(Metric metric, qint64 value, const QString &label = QString());
+
+    // Durations are recorded in usecs on a monotonic clock
+    static qint64 now();
+
+    // QSqlQuery::exec() timed under the given statement label
+    static bool exec(QSqlQuery *query, const QString &statement);
+
+    // Prometheus text exposition format
+    static QByteArray exposition();
+
+private:
+    struct Value {
+        qint64 value, sum, count;
+        qint64 buckets[MaxBuckets];
+
+        Value();
+
+        void merge(const Value &other);
+    };
+
+    // Written by its own thread only, the mutex is contended just while a scrape copies it
+    struct Shard {
+        QMutex mutex;
+        QHash<Key, Value> values;
+    };
+
+    static PerThread<Shard> shards;
+};
+
+uint qHash(const Metrics::Key &key);
+
+#endif // METRICS_H
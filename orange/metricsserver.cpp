@@ -0,0 +1,62 @@
+#include <QTcpSocket>
+
+#include "metrics.h"
+#include "metricsserver.h"
+
+MetricsServer::MetricsServer(QObject *parent) :
+    QTcpServer(parent)
+{
+    connect(this, SIGNAL(newConnection()), SLOT(onNewConnection()));
+}
+
+void MetricsServer::respond(QTcpSocket *socket, QByteArray status, QByteArray body)
+{
+    socket->write("HTTP/1.0 " + status + "\r\n"
+                  "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                  "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                  "Connection: close\r\n"
+                  "\r\n");
+    socket->write(body);
+    socket->disconnectFromHost();
+}
+
+void MetricsServer::onNewConnection()
+{
+    while (hasPendingConnections()) {
+        QTcpSocket *socket = nextPendingConnection();
+
+        connect(socket, SIGNAL(readyRead()), SLOT(onSocketReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void MetricsServer::onSocketReadyRead()
+{
+    QTcpSocket *socket = (QTcpSocket *) sender();
+
+    // Only the request line matters, the headers are read up to their end and ignored
+    QByteArray request = socket->peek(MaxRequestLength);
+
+    bool complete = request.contains("\r\n\r\n") || request.contains("\n\n");
+
+    if (!complete && request.size() < MaxRequestLength)
+        return;
+
+    socket->readAll();
+    disconnect(socket, SIGNAL(readyRead()), this, SLOT(onSocketReadyRead()));
+
+    if (!complete) {
+        respond(socket, "431 Request Header Fields Too Large", QByteArray());
+
+        return;
+    }
+
+    QList<QByteArray> requestLine = request.left(request.indexOf('\n')).trimmed().split(' ');
+
+    if (requestLine.count() < 2 || requestLine.at(0) != "GET")
+        respond(socket, "405 Method Not Allowed", QByteArray());
+    else if (requestLine.at(1) != "/metrics")
+        respond(socket, "404 Not Found", QByteArray());
+    else
+        respond(socket, "200 OK", Metrics::exposition());
+}
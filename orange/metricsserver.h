@@ -0,0 +1,28 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QTcpServer>
+
+class QTcpSocket;
+
+// Minimal HTTP endpoint answering GET /metrics for Prometheus scrapes
+class MetricsServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    enum {
+        MaxRequestLength = 8192
+    };
+
+    explicit MetricsServer(QObject *parent = 0);
+
+private:
+    void respond(QTcpSocket *socket, QByteArray status, QByteArray body);
+
+private slots:
+    void onNewConnection();
+    void onSocketReadyRead();
+};
+
+#endif // METRICSSERVER_H
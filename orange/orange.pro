@@ -9,6 +9,10 @@ include(../../lib/qt-solutions/qtservice/src/qtservice.pri)
 QT       += core network sql
 QT       -= gui
 
+# libpq-fe.h lives in /usr/include/postgresql on Debian, pkg-config knows both paths
+CONFIG   += link_pkgconfig
+PKGCONFIG += libpq
+
 TARGET = orange
 
 CONFIG   += console
@@ -22,7 +26,32 @@ SOURCES += main.cpp \
     worker.cpp \
     client.cpp \
     asterisk.cpp \
-    group.cpp
+    group.cpp \
+    groupset.cpp \
+    symbols.cpp \
+    admission.cpp \
+    statistics.cpp \
+    ingestor.cpp \
+    queue.cpp \
+    distributor.cpp \
+    parser.cpp \
+    framing.cpp \
+    timingwheel.cpp \
+    configuration.cpp \
+    bufferpool.cpp \
+    handoff.cpp \
+    statefile.cpp \
+    readiness.cpp \
+    directory.cpp \
+    clonedconnection.cpp \
+    dialauthorization.cpp \
+    wakeup.cpp \
+    epolldispatcher.cpp \
+    logger.cpp \
+    metrics.cpp \
+    tracer.cpp \
+    metricsserver.cpp \
+    controlserver.cpp
 
 HEADERS += \
     service.h \
@@ -31,4 +60,31 @@ HEADERS += \
     common.h \
     terminal.h \
     asterisk.h \
-    group.h
+    group.h \
+    groupset.h \
+    symbols.h \
+    admission.h \
+    statistics.h \
+    ingestor.h \
+    queue.h \
+    distributor.h \
+    parser.h \
+    framing.h \
+    timingwheel.h \
+    configuration.h \
+    bufferpool.h \
+    handoff.h \
+    statefile.h \
+    readiness.h \
+    directory.h \
+    clonedconnection.h \
+    dialauthorization.h \
+    wakeup.h \
+    channel.h \
+    epolldispatcher.h \
+    logger.h \
+    metrics.h \
+    perthread.h \
+    tracer.h \
+    metricsserver.h \
+    controlserver.h
@@ -0,0 +1,403 @@
+#include <string.h>
+
+#include "parser.h"
+
+enum {
+    ElementCount = Parser::Framing + 1,
+    HashSize = 32
+};
+
+static const char *elementNames[ElementCount] = {
+    "",
+    "stream",
+    "beat",
+    "authentication",
+    "action",
+    "ready",
+    "ask-dial-authorization",
+    "spy",
+    "status",
+    "statistics",
+    "framing"
+};
+
+static inline int elementHash(const char *name, int length)
+{
+    return (length + (uchar) name[0] + 5 * (uchar) name[length - 1]) & (HashSize - 1);
+}
+
+// The hash is collision free over the vocabulary above, extending it means checking the assert below still holds
+struct ElementTable {
+    Parser::Element elements[HashSize];
+    int lengths[ElementCount];
+
+    ElementTable()
+    {
+        for (int i = 0; i < HashSize; ++i)
+            elements[i] = Parser::Unknown;
+
+        lengths[Parser::Unknown] = 0;
+
+        for (int i = Parser::Unknown + 1; i < ElementCount; ++i) {
+            int length = qstrlen(elementNames[i]),
+                hash = elementHash(elementNames[i], length);
+
+            Q_ASSERT_X(elements[hash] == Parser::Unknown, "ElementTable", "element name hash collision");
+
+            elements[hash] = (Parser::Element) i;
+            lengths[i] = length;
+        }
+    }
+};
+
+static const ElementTable elementTable;
+
+static inline bool isSpace(char character)
+{
+    return character == ' ' || character == '\t' || character == '\n' || character == '\r';
+}
+
+bool Parser::Slice::operator==(const char *other) const
+{
+    return (int) qstrlen(other) == length && memcmp(data, other, length) == 0;
+}
+
+Parser::Parser() :
+    position(0)
+{
+    // Clients hand in a pooled buffer through setBuffer(), nothing is allocated up front
+}
+
+void Parser::append(const QByteArray &data)
+{
+    buffer.append(data);
+}
+
+void Parser::read(QIODevice *device)
+{
+    int available = device->bytesAvailable(),
+        size = buffer.size();
+
+    if (available <= 0)
+        return;
+
+    // Reading straight into the buffer avoids the temporary that readAll() would allocate
+    buffer.resize(size + available);
+
+    int received = device->read(buffer.data() + size, available);
+
+    buffer.resize(size + qMax(received, 0));
+}
+
+bool Parser::next(Parser::Token *token)
+{
+    forever {
+        int size = buffer.size();
+
+        if (position >= size)
+            return false;
+
+        const char *data = buffer.constData();
+
+        if (data[position] != '<') {
+            int tagStart = buffer.indexOf('<', position);
+
+            // Text is only complete once the following tag starts
+            if (tagStart < 0)
+                return false;
+
+            int begin = position;
+            bool blank = true;
+
+            for (int i = begin; i < tagStart && blank; ++i)
+                blank = isSpace(data[i]);
+
+            position = tagStart;
+
+            if (blank)
+                continue;
+
+            token->type = Characters;
+            token->element = Unknown;
+            token->name.data = data + begin;
+            token->name.length = 0;
+            token->text.data = data + begin;
+            token->text.length = tagStart - begin;
+            token->selfClosing = false;
+            token->attributeCount = 0;
+            token->begin = begin;
+            token->end = tagStart;
+
+            return true;
+        }
+
+        if (size - position < 2)
+            return false;
+
+        if (data[position + 1] == '?') {
+            int end = buffer.indexOf("?>", position);
+
+            if (end < 0)
+                return false;
+
+            position = end + 2;
+
+            continue;
+        }
+
+        if (data[position + 1] == '!') {
+            bool comment = buffer.mid(position, 4) == "<!--";
+            int end = comment ? buffer.indexOf("-->", position) : buffer.indexOf('>', position);
+
+            if (end < 0)
+                return false;
+
+            position = end + (comment ? 3 : 1);
+
+            continue;
+        }
+
+        int end = findTagEnd(position + 1);
+
+        if (end < 0)
+            return false;
+
+        bool parsed = parseTag(token, end);
+
+        position = end + 1;
+
+        if (parsed)
+            return true;
+    }
+}
+
+void Parser::compact()
+{
+    if (position <= 0)
+        return;
+
+    // remove() keeps the reserved capacity, so steady state parsing does not allocate
+    buffer.remove(0, position);
+    position = 0;
+}
+
+void Parser::clear()
+{
+    buffer.resize(0);
+    position = 0;
+}
+
+void Parser::setBuffer(QByteArray buffer)
+{
+    buffer.append(pending());
+
+    this->buffer = buffer;
+
+    position = 0;
+}
+
+QByteArray Parser::takeBuffer()
+{
+    QByteArray taken = buffer;
+
+    buffer = QByteArray();
+    position = 0;
+
+    return taken;
+}
+
+QByteArray Parser::raw(const Parser::Token &token) const
+{
+    return buffer.mid(token.begin, token.end - token.begin);
+}
+
+QByteArray Parser::pending() const
+{
+    return buffer.mid(position);
+}
+
+int Parser::pendingLength() const
+{
+    return buffer.size() - position;
+}
+
+Parser::Element Parser::lookup(const char *name, int length)
+{
+    if (length <= 0)
+        return Unknown;
+
+    Element element = elementTable.elements[elementHash(name, length)];
+
+    if (element != Unknown && elementTable.lengths[element] == length && memcmp(elementNames[element], name, length) == 0)
+        return element;
+
+    return Unknown;
+}
+
+QString Parser::elementName(Parser::Element element)
+{
+    return QString::fromLatin1(elementNames[element]);
+}
+
+Parser::Slice Parser::attribute(const Parser::Token &token, const char *name)
+{
+    for (int i = 0; i < token.attributeCount; ++i) {
+        if (token.attributes[i].name == name)
+            return token.attributes[i].value;
+    }
+
+    Slice empty;
+    empty.data = "";
+    empty.length = 0;
+
+    return empty;
+}
+
+QString Parser::decode(Parser::Slice slice)
+{
+    if (memchr(slice.data, '&', slice.length) == NULL)
+        return QString::fromUtf8(slice.data, slice.length);
+
+    QByteArray decoded;
+    decoded.reserve(slice.length);
+
+    for (int i = 0; i < slice.length; ++i) {
+        if (slice.data[i] != '&') {
+            decoded.append(slice.data[i]);
+
+            continue;
+        }
+
+        const char *semicolon = (const char *) memchr(slice.data + i, ';', slice.length - i);
+
+        if (semicolon == NULL) {
+            decoded.append(slice.data + i, slice.length - i);
+
+            break;
+        }
+
+        QByteArray entity(slice.data + i + 1, semicolon - slice.data - i - 1);
+
+        if (entity == "lt")
+            decoded.append('<');
+        else if (entity == "gt")
+            decoded.append('>');
+        else if (entity == "amp")
+            decoded.append('&');
+        else if (entity == "quot")
+            decoded.append('"');
+        else if (entity == "apos")
+            decoded.append('\'');
+        else if (entity.startsWith("#x"))
+            decoded.append(QString(QChar(entity.mid(2).toUInt(0, 16))).toUtf8());
+        else if (entity.startsWith('#'))
+            decoded.append(QString(QChar(entity.mid(1).toUInt())).toUtf8());
+
+        i = semicolon - slice.data;
+    }
+
+    return QString::fromUtf8(decoded);
+}
+
+QXmlStreamAttributes Parser::attributes(const Parser::Token &token)
+{
+    QXmlStreamAttributes attributes;
+
+    for (int i = 0; i < token.attributeCount; ++i)
+        attributes.append(QString::fromLatin1(token.attributes[i].name.data, token.attributes[i].name.length),
+                          decode(token.attributes[i].value));
+
+    return attributes;
+}
+
+bool Parser::parseTag(Parser::Token *token, int end)
+{
+    const char *data = buffer.constData();
+    int index = position + 1;
+
+    token->begin = position;
+    token->end = end + 1;
+    token->text.data = data + end;
+    token->text.length = 0;
+    token->attributeCount = 0;
+    token->selfClosing = false;
+
+    if (data[index] == '/') {
+        token->type = EndElement;
+        index++;
+    } else {
+        token->type = StartElement;
+        token->selfClosing = data[end - 1] == '/';
+    }
+
+    int limit = token->selfClosing ? end - 1 : end,
+        nameStart = index;
+
+    while (index < limit && !isSpace(data[index]))
+        index++;
+
+    token->name.data = data + nameStart;
+    token->name.length = index - nameStart;
+    token->element = lookup(token->name.data, token->name.length);
+
+    if (token->name.length <= 0)
+        return false;
+
+    while (token->type == StartElement && index < limit) {
+        while (index < limit && isSpace(data[index]))
+            index++;
+
+        int attributeStart = index;
+
+        while (index < limit && data[index] != '=' && !isSpace(data[index]))
+            index++;
+
+        int attributeLength = index - attributeStart;
+
+        while (index < limit && (isSpace(data[index]) || data[index] == '='))
+            index++;
+
+        if (attributeLength <= 0 || index >= limit || (data[index] != '"' && data[index] != '\''))
+            break;
+
+        char quote = data[index++];
+        int valueStart = index;
+
+        while (index < limit && data[index] != quote)
+            index++;
+
+        if (token->attributeCount < MaxAttributes) {
+            Attribute &attribute = token->attributes[token->attributeCount++];
+            attribute.name.data = data + attributeStart;
+            attribute.name.length = attributeLength;
+            attribute.value.data = data + valueStart;
+            attribute.value.length = index - valueStart;
+        }
+
+        index++;
+    }
+
+    return true;
+}
+
+int Parser::findTagEnd(int from)
+{
+    const char *data = buffer.constData();
+    int size = buffer.size();
+    char quote = 0;
+
+    for (int i = from; i < size; ++i) {
+        char character = data[i];
+
+        if (quote != 0) {
+            if (character == quote)
+                quote = 0;
+        } else if (character == '"' || character == '\'') {
+            quote = character;
+        } else if (character == '>') {
+            return i;
+        }
+    }
+
+    return -1;
+}
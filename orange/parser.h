@@ -0,0 +1,88 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QIODevice>
+#include <QXmlStreamAttributes>
+
+class Parser
+{
+public:
+    enum Element {
+        Unknown,
+        Stream,
+        Beat,
+        Authentication,
+        Action,
+        Ready,
+        AskDialAuthorization,
+        Spy,
+        Status,
+        Statistics,
+        Framing
+    };
+
+    enum TokenType {
+        StartElement,
+        EndElement,
+        Characters
+    };
+
+    enum {
+        MaxAttributes = 12,
+        MaxPendingLength = 65536 // unfinished tag or text, a client sending more than that is cut off
+    };
+
+    struct Slice {
+        const char *data;
+        int length;
+
+        bool operator==(const char *other) const;
+    };
+
+    struct Attribute {
+        Slice name, value;
+    };
+
+    struct Token {
+        TokenType type;
+        Element element;
+        Slice name, text;
+        bool selfClosing;
+        Attribute attributes[MaxAttributes];
+        int attributeCount;
+        int begin, end; // raw span in the buffer, valid until the next compact()
+    };
+
+    Parser();
+
+    void append(const QByteArray &data);
+    void read(QIODevice *device);
+    bool next(Token *token);
+    void compact();
+    void clear();
+
+    void setBuffer(QByteArray buffer);
+    QByteArray takeBuffer();
+
+    QByteArray raw(const Token &token) const;
+    QByteArray pending() const;
+    int pendingLength() const;
+
+    static Element lookup(const char *name, int length);
+    static QString elementName(Element element);
+
+    static Slice attribute(const Token &token, const char *name);
+    static QString decode(Slice slice);
+    static QXmlStreamAttributes attributes(const Token &token);
+
+private:
+    QByteArray buffer;
+    int position;
+
+    bool parseTag(Token *token, int end);
+    int findTagEnd(int from);
+};
+
+#endif // PARSER_H
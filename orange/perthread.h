@@ -0,0 +1,81 @@
+#ifndef PERTHREAD_H
+#define PERTHREAD_H
+
+#include <QMutex>
+#include <QList>
+#include <QThreadStorage>
+
+// One T for each thread, created on its first use and registered so that another thread can walk them all.
+// The calling thread's instance is found through a thread local pointer, so keep a single PerThread per T.
+// A thread that exits hands its instance back with whatever it still held, the next new thread carries on with it.
+template <typename T>
+class PerThread
+{
+public:
+    T *local();
+    QList<T *> all();
+
+private:
+    // Deleted by QThreadStorage when its thread exits
+    struct Lease {
+        PerThread *owner;
+        T *instance;
+
+        ~Lease();
+    };
+
+    QMutex mutex; // only taken when a thread starts or exits, and by all()
+    QList<T *> instances, released;
+    QThreadStorage<Lease *> leases;
+
+    static __thread T *current;
+};
+
+template <typename T>
+__thread T *PerThread<T>::current = NULL;
+
+template <typename T>
+T *PerThread<T>::local()
+{
+    if (current == NULL) {
+        Lease *lease = new Lease;
+        lease->owner = this;
+
+        mutex.lock();
+
+        if (!released.isEmpty()) {
+            lease->instance = released.takeLast();
+        } else {
+            lease->instance = new T;
+            instances.append(lease->instance);
+        }
+
+        mutex.unlock();
+
+        leases.setLocalData(lease);
+
+        current = lease->instance;
+    }
+
+    return current;
+}
+
+template <typename T>
+QList<T *> PerThread<T>::all()
+{
+    QMutexLocker locker(&mutex);
+
+    return instances;
+}
+
+template <typename T>
+PerThread<T>::Lease::~Lease()
+{
+    QMutexLocker locker(&owner->mutex);
+
+    owner->released.append(instance);
+
+    current = NULL;
+}
+
+#endif // PERTHREAD_H
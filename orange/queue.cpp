@@ -0,0 +1,147 @@
+#include <QDateTime>
+
+#include "queue.h"
+
+// Asterisk device states as reported in QueueMember and QueueMemberStatus
+enum {
+    DeviceNotInUse = 1,
+    DeviceInUse,
+    DeviceBusy,
+    DeviceInvalid,
+    DeviceUnavailable,
+    DeviceRinging,
+    DeviceRingInUse,
+    DeviceOnHold
+};
+
+Queue::Queue(QString name) :
+    name(name),
+    completed(0),
+    abandoned(0),
+    answeredWithin(0),
+    serviceLevelThreshold(20),
+    dirty(true)
+{
+}
+
+void Queue::seedParams(QVariantHash headers)
+{
+    completed = headers.value("Completed").toInt();
+    abandoned = headers.value("Abandoned").toInt();
+    serviceLevelThreshold = headers.value("ServiceLevel", 20).toInt();
+    answeredWithin = qRound(headers.value("ServiceLevelPerf").toDouble() * completed / 100);
+
+    callers.clear();
+    members.clear();
+
+    dirty = true;
+}
+
+void Queue::seedMember(QVariantHash headers)
+{
+    Member member;
+    member.status = headers.value("Status").toInt();
+    member.paused = headers.value("Paused").toInt() != 0;
+    member.callsTaken = headers.value("CallsTaken").toInt();
+
+    members.insert(memberInterface(headers), member);
+
+    dirty = true;
+}
+
+void Queue::seedEntry(QVariantHash headers)
+{
+    qint64 wait = headers.value("Wait").toLongLong() * 1000;
+
+    callers.insert(headers.value("Uniqueid").toString(), QDateTime::currentMSecsSinceEpoch() - wait);
+
+    dirty = true;
+}
+
+void Queue::callerJoined(QVariantHash headers)
+{
+    callers.insert(headers.value("Uniqueid").toString(), QDateTime::currentMSecsSinceEpoch());
+
+    dirty = true;
+}
+
+void Queue::callerLeft(QVariantHash headers)
+{
+    if (callers.remove(headers.value("Uniqueid").toString()) > 0)
+        dirty = true;
+}
+
+void Queue::callerAbandoned(QVariantHash headers)
+{
+    callers.remove(headers.value("Uniqueid").toString());
+    abandoned++;
+
+    dirty = true;
+}
+
+void Queue::callerConnected(QVariantHash headers)
+{
+    callers.remove(headers.value("Uniqueid").toString());
+    completed++;
+
+    if (headers.value("HoldTime").toInt() <= serviceLevelThreshold)
+        answeredWithin++;
+
+    dirty = true;
+}
+
+void Queue::memberStatusChanged(QVariantHash headers)
+{
+    QString interface = memberInterface(headers);
+    Member &member = members[interface];
+
+    member.status = headers.value("Status").toInt();
+    member.paused = headers.value("Paused").toInt() != 0;
+    member.callsTaken = headers.value("CallsTaken").toInt();
+
+    dirty = true;
+}
+
+bool Queue::isDirty()
+{
+    // Longest wait keeps growing while callers are waiting, even without any event
+    return dirty || !callers.isEmpty();
+}
+
+Queue::Snapshot Queue::takeSnapshot()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch(),
+           oldest = now;
+
+    foreach (qint64 since, callers)
+        oldest = qMin(oldest, since);
+
+    Snapshot snapshot;
+    snapshot.name = name;
+    snapshot.waiting = callers.count();
+    snapshot.longestWait = (now - oldest) / 1000;
+    snapshot.completed = completed;
+    snapshot.abandoned = abandoned;
+    snapshot.serviceLevel = completed + abandoned > 0 ? answeredWithin * 100 / (completed + abandoned) : 100;
+    snapshot.available = 0;
+    snapshot.busy = 0;
+    snapshot.paused = 0;
+
+    foreach (const Member &member, members) {
+        if (member.paused)
+            snapshot.paused++;
+        else if (member.status == DeviceNotInUse)
+            snapshot.available++;
+        else if (member.status != DeviceInvalid && member.status != DeviceUnavailable)
+            snapshot.busy++;
+    }
+
+    dirty = false;
+
+    return snapshot;
+}
+
+QString Queue::memberInterface(QVariantHash headers)
+{
+    return headers.contains("Interface") ? headers.value("Interface").toString() : headers.value("Location").toString();
+}
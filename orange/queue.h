@@ -0,0 +1,51 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <QHash>
+#include <QString>
+#include <QVariantHash>
+#include <QMetaType>
+
+class Queue
+{
+public:
+    struct Member {
+        int status; // Asterisk device state
+        bool paused;
+        int callsTaken;
+    };
+
+    struct Snapshot {
+        QString name;
+        int waiting, longestWait, completed, abandoned, serviceLevel;
+        int available, busy, paused;
+    };
+
+    explicit Queue(QString name = QString());
+
+    void seedParams(QVariantHash headers);
+    void seedMember(QVariantHash headers);
+    void seedEntry(QVariantHash headers);
+
+    void callerJoined(QVariantHash headers);
+    void callerLeft(QVariantHash headers);
+    void callerAbandoned(QVariantHash headers);
+    void callerConnected(QVariantHash headers);
+    void memberStatusChanged(QVariantHash headers);
+
+    bool isDirty();
+    Snapshot takeSnapshot();
+
+private:
+    QString name;
+    QHash<QString, qint64> callers; // key: Uniqueid, value: join time in msecs
+    QHash<QString, Member> members; // key: Interface
+    int completed, abandoned, answeredWithin, serviceLevelThreshold;
+    bool dirty;
+
+    static QString memberInterface(QVariantHash headers);
+};
+
+Q_DECLARE_METATYPE(Queue::Snapshot)
+
+#endif // QUEUE_H
@@ -0,0 +1,78 @@
+#include <QDebug>
+
+#include "terminal.h"
+#include "readiness.h"
+
+Readiness::Readiness(QObject *parent) :
+    QObject(parent),
+    reported(false)
+{
+}
+
+void Readiness::addStage(QString stage, QStringList dependencies)
+{
+    stages.append(stage);
+
+    this->dependencies.insert(stage, dependencies);
+}
+
+void Readiness::start()
+{
+    clock.start();
+
+    dispatch();
+}
+
+void Readiness::markReady(QString stage)
+{
+    if (completed.contains(stage))
+        return;
+
+    completed.insert(stage);
+
+    qDebug() << "Startup stage" BOLD BLUE << stage << RESET "ready after" BOLD BLUE << clock.elapsed() << RESET "ms";
+
+    dispatch();
+
+    if (!reported && completed.count() == stages.count()) {
+        reported = true;
+
+        qDebug() << "Service ready, time to ready:" BOLD GREEN << clock.elapsed() << RESET "ms";
+
+        emit ready(clock.elapsed());
+    }
+}
+
+bool Readiness::isReady(QString stage)
+{
+    return completed.contains(stage);
+}
+
+qint64 Readiness::elapsed()
+{
+    return clock.isValid() ? clock.elapsed() : 0;
+}
+
+void Readiness::dispatch()
+{
+    foreach (QString stage, stages) {
+        if (started.contains(stage))
+            continue;
+
+        bool runnable = true;
+
+        foreach (QString dependency, dependencies.value(stage)) {
+            if (!completed.contains(dependency) && stages.contains(dependency)) {
+                runnable = false;
+
+                break;
+            }
+        }
+
+        if (runnable) {
+            started.insert(stage);
+
+            emit stageRunnable(stage);
+        }
+    }
+}
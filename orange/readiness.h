@@ -0,0 +1,40 @@
+#ifndef READINESS_H
+#define READINESS_H
+
+#include <QObject>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QElapsedTimer>
+
+// Startup stages with explicit dependencies, a stage becomes runnable once everything it depends on is ready
+class Readiness : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Readiness(QObject *parent = 0);
+
+    void addStage(QString stage, QStringList dependencies = QStringList());
+    void start();
+
+    void markReady(QString stage);
+    bool isReady(QString stage);
+
+    qint64 elapsed();
+
+private:
+    QElapsedTimer clock;
+    QStringList stages; // in the order they were added
+    QHash<QString, QStringList> dependencies; // key: Stage
+    QSet<QString> started, completed;
+    bool reported;
+
+    void dispatch();
+
+signals:
+    void stageRunnable(QString stage);
+    void ready(qint64 elapsed);
+};
+
+#endif // READINESS_H
@@ -1,22 +1,47 @@
 #include <QTcpSocket>
+#include <QLocalSocket>
+#include <QJsonArray>
 #include <QTimer>
+#include <QSqlError>
 #include <QDebug>
 
+#include <unistd.h>
+
 #include "common.h"
 #include "terminal.h"
+#include "logger.h"
+#include "metrics.h"
+#include "tracer.h"
+#include "symbols.h"
 #include "service.h"
 
 Service::Service(int &argc, char **argv) :
     QObject(),
     QtService<QCoreApplication>(argc, argv, APPLICATION_NAME),
+    ingestor(NULL),
+    distributor(NULL),
+    stateFile(NULL),
+    readiness(NULL),
+    directory(NULL),
+    dialAuthorization(NULL),
+    eventWakeup(NULL),
+    events(NULL),
+    spyTimeout(0),
     workerCount(1),
     currentWorkerIndex(0)
 {
+    // Registered once here rather than by every Client constructor
+    qRegisterMetaType<Client::Status>("Client::Status");
+    qRegisterMetaType<Statistics::Report>("Statistics::Report");
+    qRegisterMetaType<Queue::Snapshot>("Queue::Snapshot");
+
     qDebug("Service initialized");
 }
 
 Service::~Service()
 {
+    delete events;
+
     qDebug("Service destroyed");
 }
 
@@ -24,11 +49,27 @@ void Service::createApplication(int &argc, char **argv)
 {
     QtService::createApplication(argc, argv);
 
+    // Its notifier needs the event dispatcher, which only exists once the application has been created
+    eventWakeup = new Wakeup(this);
+    events = new Channel<Client::Event>(eventWakeup);
+
+    connect(eventWakeup, SIGNAL(woken()), SLOT(onEventWakeupWoken()));
+
     setupSettings();
+    setupLogger();
+    setupMetrics();
+    setupTracing();
+    setupControl();
     setupServer();
     setupDatabase();
+    setupIngestor();
+    setupQueues();
+    setupDistributor();
+    setupStateFile();
     setupAsterisk();
+    setupAdmission();
     createWorkers();
+    setupReadiness();
 
     qDebug("Application created");
 }
@@ -36,13 +77,40 @@ void Service::createApplication(int &argc, char **argv)
 void Service::processCommand(int code)
 {
     qDebug() << "Received command code:" BOLD BLUE << code << RESET;
+
+    if (code < ReloadAll || code > ReloadFanout) {
+        qWarning() << "Unknown command code:" BOLD BLUE << code << RESET;
+
+        return;
+    }
+
+    reloadConfiguration();
+
+    if (code == ReloadAll || code == ReloadHeartbeat)
+        applyHeartbeat();
+
+    if (code == ReloadAll || code == ReloadDatabase)
+        applyDatabase();
+
+    if (code == ReloadAll || code == ReloadAsteriskFilter)
+        applyAsteriskFilter();
+
+    if (code == ReloadAll || code == ReloadFanout)
+        applyFanout();
 }
 
 void Service::start()
 {
-    startServer();
-    openDatabase();
-    connectToAsterisk();
+    // A previous process still running hands over its sockets instead of logging everyone out
+    resumeHandoff();
+
+    listenHandoff();
+    openStateFile();
+
+    queueTimer.start();
+
+    // The remaining stages run as soon as their dependencies are ready, see onStageRunnable()
+    readiness->start();
 
     qDebug("Service started");
 }
@@ -52,6 +120,23 @@ void Service::stop()
     forceLogoutUsers();
 //    stopWorkers();
 
+    queueTimer.stop();
+    traceTimer.stop();
+    dialAuthorizationTimer.stop();
+
+    Tracer::flush();
+
+    qDeleteAll(queues);
+    queues.clear();
+
+    if (ingestor != NULL) {
+        ingestor->stop();
+        ingestor->wait();
+
+        delete ingestor;
+        ingestor = NULL;
+    }
+
     settings->deleteLater();
     asterisk->deleteLater();
 
@@ -61,11 +146,60 @@ void Service::stop()
 void Service::setupSettings()
 {
     settings = new QSettings(CONFIG_FILE, QSettings::IniFormat);
+    configuration = ConfigurationPointer(new Configuration(settings));
+}
+
+void Service::setupLogger()
+{
+    Logger::instance()->configure(Logger::levelFromText(settings->value("orange/log_level", "info").toString()),
+                                  settings->value("orange/log_file").toString());
+}
+
+void Service::setupMetrics()
+{
+    QHostAddress address(settings->value("metrics/address", "127.0.0.1").toString());
+    int port = settings->value("metrics/port", 9464).toInt();
+
+    // Port 0 turns the endpoint off
+    if (port <= 0)
+        return;
+
+    if (metricsServer.listen(address, port))
+        qDebug() << "Metrics are exposed on:" BOLD BLUE << QString("%1:%2").arg(address.toString()).arg(port) << RESET;
+    else
+        qWarning() << "Metrics endpoint could not listen:" BOLD CYAN << metricsServer.errorString() << RESET;
+}
+
+void Service::setupTracing()
+{
+    double sampleRate = settings->value("tracing/sample_rate", 0).toDouble();
+
+    if (!Tracer::configure(sampleRate, settings->value("tracing/file", "/var/log/orange/trace.json").toString()) || !Tracer::isEnabled())
+        return;
+
+    traceTimer.setInterval(settings->value("tracing/flush_interval", 1000).toInt());
+
+    connect(&traceTimer, SIGNAL(timeout()), SLOT(onTraceTimerTimeout()));
+
+    traceTimer.start();
+}
+
+void Service::setupControl()
+{
+    QString path = settings->value("orange/control_socket", "/var/run/orange.control").toString();
+
+    connect(&controlServer, SIGNAL(requestReceived(QLocalSocket*,QStringList)), SLOT(onControlRequestReceived(QLocalSocket*,QStringList)));
+
+    if (controlServer.listenOn(path))
+        qDebug() << "Control socket listening on:" BOLD BLUE << path << RESET;
+    else
+        qWarning() << "Control socket could not listen:" BOLD CYAN << controlServer.errorString() << RESET;
 }
 
 void Service::setupServer()
 {
     connect(&server, SIGNAL(newConnection()), SLOT(onServerNewConnection()));
+    connect(&handoffServer, SIGNAL(newConnection()), SLOT(onHandoffServerNewConnection()));
 
     qDebug("Server has been setup");
 }
@@ -84,9 +218,25 @@ void Service::setupAsterisk()
     QString host = settings->value("asterisk/host", "localhost").toString();
     quint16 port = settings->value("asterisk/port", 5038).toUInt();
 
+    // The supervisor's own phone is called first, then bridged into ChanSpy
+    spyChannel = settings->value("asterisk/spy_channel", "SIP/%1").toString();
+    spyTimeout = settings->value("asterisk/spy_timeout", 30).toUInt() * 1000;
+
     asterisk = new Asterisk(this, host, port);
+    asterisk->setIgnoredEvents(configuration->ignoredEvents);
 
     connect(asterisk, SIGNAL(eventReceived(QString,QVariantHash)), SLOT(onAsteriskEventReceived(QString,QVariantHash)));
+    connect(asterisk, SIGNAL(loginFinished(bool,QString)), SLOT(onAsteriskLoginFinished(bool,QString)));
+    connect(asterisk, SIGNAL(originateFinished(QString,bool,QString)), SLOT(onAsteriskOriginateFinished(QString,bool,QString)));
+}
+
+void Service::setupAdmission()
+{
+    int concurrency = configuration->loginConcurrency,
+        queueLimit = settings->value("orange/login_queue_limit", 2000).toInt(),
+        timeout = settings->value("orange/login_timeout", 30).toInt();
+
+    admission = new Admission(this, concurrency, queueLimit, timeout);
 }
 
 void Service::createWorkers()
@@ -96,8 +246,10 @@ void Service::createWorkers()
     if (workerCount > 1)
         workerCount--;
 
+    Worker::Backend backend = Worker::backendFromText(settings->value("orange/worker_backend", "qt").toString());
+
     for (int i = 0; i < workerCount; ++i) {
-        Worker *worker = new Worker(i);
+        Worker *worker = new Worker(i, configuration->heartbeatTimeout, backend);
         worker->start();
 
         workers.append(worker);
@@ -135,6 +287,226 @@ void Service::setupDatabase()
         database.setPassword(password);
 }
 
+void Service::setupIngestor()
+{
+    if (!settings->value("ingest/enabled", false).toBool())
+        return;
+
+    Ingestor::Database database;
+    database.host = settings->value("database/host", "localhost").toString();
+    database.name = settings->value("database/name", "icentra").toString();
+    database.username = settings->value("database/username", "icentra").toString();
+    database.password = settings->value("database/password").toString();
+    database.port = settings->value("database/port", 5432).toInt();
+
+    QString spoolPath = settings->value("ingest/spool_file", "/var/spool/orange/ingest.spool").toString(),
+            deadLetterPath = settings->value("ingest/dead_letter_file", "/var/spool/orange/ingest.dead").toString();
+    int capacity = settings->value("ingest/capacity", 20000).toInt(),
+        batchSize = configuration->ingestBatchSize,
+        flushInterval = configuration->ingestFlushInterval;
+
+    ingestor = new Ingestor(database, spoolPath, deadLetterPath, capacity, batchSize, flushInterval);
+}
+
+void Service::setupQueues()
+{
+    // Queue metrics are pushed to supervisors at a bounded rate, no matter how busy the event stream is
+    queueTimer.setInterval(configuration->queuePushInterval);
+
+    connect(&queueTimer, SIGNAL(timeout()), SLOT(onQueueTimerTimeout()));
+}
+
+void Service::setupDistributor()
+{
+    if (!settings->value("acd/enabled", false).toBool())
+        return;
+
+    distributor = new Distributor(this, settings->value("acd/reservation_timeout", 30).toInt());
+}
+
+void Service::setupStateFile()
+{
+    QString path = settings->value("orange/state_file", "/var/lib/orange/state").toString();
+    int capacity = settings->value("orange/state_capacity", 4096).toInt();
+
+    stateFile = new StateFile(path, capacity);
+
+    stateTimer.setInterval(settings->value("orange/state_sync_interval", 5000).toInt());
+
+    connect(&stateTimer, SIGNAL(timeout()), SLOT(onStateTimerTimeout()));
+}
+
+void Service::openStateFile()
+{
+    if (!stateFile->open())
+        return;
+
+    QHashIterator<QString, Client *> clientAddress(addressClientMap);
+
+    // Sessions resumed through a handoff are alive, they only need their record written again
+    while (clientAddress.hasNext()) {
+        clientAddress.next();
+
+        StateFile::Record record;
+        int slot;
+
+        if (stateFile->takeRecovered(clientAddress.value()->getUsername(), 0, &record, &slot))
+            QMetaObject::invokeMethod(clientAddress.value(), "adoptStateSlot", Qt::QueuedConnection, Q_ARG(int, slot));
+        else
+            QMetaObject::invokeMethod(clientAddress.value(), "updateStateRecord", Qt::QueuedConnection);
+    }
+
+    stateTimer.start();
+
+    // Agents that do not come back in time get their sessions closed at the moment of the crash
+    QTimer::singleShot(settings->value("orange/state_grace", 300).toInt() * 1000, this, SLOT(closeOrphanedSessions()));
+}
+
+void Service::setupReadiness()
+{
+    // Clients are only accepted once these stages are ready
+    QStringList requirements = settings->value("orange/ready_requires", QStringList() << "database" << "directory").toStringList();
+
+    directory = new Directory(database, this);
+
+    connect(directory, SIGNAL(finished()), SLOT(onDirectoryFinished()));
+
+    DialAuthorization::Numbering numbering;
+    numbering.countryCode = settings->value("dialer/country_code", "62").toString();
+    numbering.nationalPrefix = settings->value("dialer/national_prefix", "0").toString();
+    numbering.internationalPrefix = settings->value("dialer/international_prefix", "00").toString();
+    numbering.minimumLength = settings->value("dialer/minimum_length", 6).toInt();
+    numbering.maximumLength = settings->value("dialer/maximum_length", 15).toInt();
+
+    dialAuthorization = new DialAuthorization(database, numbering, this);
+
+    connect(dialAuthorization, SIGNAL(finished()), SLOT(onDialAuthorizationFinished()));
+
+    // Every reload reads the whole do-not-call list again, by default only "orangectl reload dialer" triggers one
+    dialAuthorizationTimer.setInterval(settings->value("dialer/reload_interval", 0).toInt() * 1000);
+
+    connect(&dialAuthorizationTimer, SIGNAL(timeout()), SLOT(loadDialAuthorization()));
+
+    readiness = new Readiness(this);
+    readiness->addStage("asterisk");
+    readiness->addStage("directory");
+    readiness->addStage("dialer");
+    readiness->addStage("database");
+
+    if (ingestor != NULL)
+        readiness->addStage("ingestor");
+
+    if (distributor != NULL)
+        readiness->addStage("acd", QStringList() << "database");
+
+    readiness->addStage("server", requirements);
+
+    // Queued, so that every independent stage is kicked off before any of them runs
+    connect(readiness, SIGNAL(stageRunnable(QString)), SLOT(onStageRunnable(QString)), Qt::QueuedConnection);
+}
+
+void Service::reloadConfiguration()
+{
+    settings->sync();
+
+    // Clients keep the snapshot they were created with, new connections pick up the fresh one
+    configuration = ConfigurationPointer(new Configuration(settings));
+
+    qDebug("Configuration reloaded");
+}
+
+void Service::applyHeartbeat()
+{
+    // Each wheel lives on its worker thread, the change is queued there instead of disturbing any connection
+    foreach (Worker *worker, workers)
+        QMetaObject::invokeMethod(worker->getHeartbeatWheel(), "setTimeout", Qt::QueuedConnection, Q_ARG(int, configuration->heartbeatTimeout));
+
+    qDebug() << "Heartbeat timeout changed to:" BOLD BLUE << configuration->heartbeatTimeout << RESET;
+}
+
+void Service::applyDatabase()
+{
+    admission->setConcurrency(configuration->loginConcurrency);
+
+    if (ingestor != NULL)
+        ingestor->setBatching(configuration->ingestBatchSize, configuration->ingestFlushInterval);
+}
+
+void Service::applyAsteriskFilter()
+{
+    asterisk->setIgnoredEvents(configuration->ignoredEvents);
+}
+
+void Service::applyFanout()
+{
+    queueTimer.setInterval(configuration->queuePushInterval);
+
+    qDebug() << "Queue status push interval changed to:" BOLD BLUE << configuration->queuePushInterval << RESET;
+}
+
+bool Service::resumeHandoff()
+{
+    QString path = settings->value("orange/handoff_socket", "/var/run/orange.handoff").toString();
+    Handoff channel;
+
+    if (!channel.connectTo(path))
+        return false;
+
+    QByteArray payload;
+    int descriptor = -1;
+
+    if (!channel.send(Handoff::greeting()) || !channel.receive(&payload, &descriptor) || payload != "listener" || descriptor < 0) {
+        if (descriptor >= 0)
+            ::close(descriptor);
+
+        qWarning() << "Handoff from" BOLD BLUE << path << RESET "failed, starting afresh";
+
+        return false;
+    }
+
+    server.setSocketDescriptor(descriptor);
+
+    int resumed = 0;
+
+    // An empty payload closes the handoff
+    while (channel.receive(&payload, &descriptor) && !payload.isEmpty()) {
+        if (descriptor < 0)
+            continue;
+
+        QTcpSocket *socket = new QTcpSocket;
+
+        if (!socket->setSocketDescriptor(descriptor)) {
+            ::close(descriptor);
+            delete socket;
+
+            continue;
+        }
+
+        Client *client = acceptClient(socket, payload);
+
+        if (!client->getUsername().isEmpty())
+            registerLogin(client);
+
+        resumed++;
+    }
+
+    qDebug() << "Server resumed from handoff, clients:" BOLD BLUE << resumed << RESET;
+
+    return true;
+}
+
+void Service::listenHandoff()
+{
+    QString path = settings->value("orange/handoff_socket", "/var/run/orange.handoff").toString();
+
+    QLocalServer::removeServer(path);
+
+    handoffServer.setSocketOptions(QLocalServer::UserAccessOption);
+
+    if (!handoffServer.listen(path))
+        qWarning() << "Handoff socket" BOLD BLUE << path << RESET "could not be opened:" BOLD CYAN << handoffServer.errorString() << RESET;
+}
+
 int Service::circulateWorkerIndex()
 {
     currentWorkerIndex = (currentWorkerIndex + 1) % workerCount;
@@ -152,37 +524,410 @@ void Service::forceLogoutUsers()
     }
 }
 
+QJsonObject Service::controlStats()
+{
+    QHash<Worker *, int> connections;
+
+    foreach (Client *client, addressClientMap)
+        connections[qobject_cast<Worker *>(client->thread())]++;
+
+    QJsonArray workerStats;
+
+    foreach (Worker *worker, workers) {
+        QJsonObject workerStat;
+        workerStat["index"] = worker->getIndex();
+        workerStat["connections"] = connections.value(worker);
+        workerStat["lag_ms"] = worker->getLag();
+        workerStat["deliveries"] = worker->getDeliveries()->count();
+
+        workerStats.append(workerStat);
+    }
+
+    QJsonObject asteriskStat;
+    asteriskStat["connected"] = asterisk->isConnected();
+    asteriskStat["pending_actions"] = asterisk->getPendingActions();
+
+    QJsonObject databaseStat;
+    databaseStat["open"] = database.isOpen();
+    databaseStat["concurrency"] = admission->getConcurrency();
+    databaseStat["active"] = admission->getActive();
+    databaseStat["queued"] = admission->getQueued();
+
+    QJsonObject response;
+    response["ready"] = readiness->isReady("server");
+    response["clients"] = addressClientMap.count();
+    response["agents"] = usernameAddressMap.count();
+    response["events"] = events->count();
+    response["workers"] = workerStats;
+    response["asterisk"] = asteriskStat;
+    response["database"] = databaseStat;
+
+    return response;
+}
+
+QJsonObject Service::controlAgents()
+{
+    QJsonArray agents;
+
+    foreach (Client *client, addressClientMap) {
+        if (client->getUsername().isEmpty())
+            continue;
+
+        Worker *worker = qobject_cast<Worker *>(client->thread());
+
+        QJsonObject agent;
+        agent["username"] = client->getUsername();
+        agent["level"] = (int) client->getLevel();
+        agent["status"] = Client::statusTable().key(client->getStatus());
+        agent["extension"] = client->getExtension();
+        agent["address"] = client->getIpAddress();
+        agent["worker"] = worker != NULL ? worker->getIndex() : -1;
+        agent["groups"] = QJsonArray::fromStringList(client->getGroups());
+
+        agents.append(agent);
+    }
+
+    QJsonObject response;
+    response["agents"] = agents;
+
+    return response;
+}
+
+QJsonObject Service::controlGroups()
+{
+    QJsonObject groupMembers;
+
+    QHashIterator<QString, Group *> group(groups);
+    while (group.hasNext()) {
+        group.next();
+
+        groupMembers[group.key()] = QJsonArray::fromStringList(group.value()->getMembers());
+    }
+
+    QJsonObject response;
+    response["groups"] = groupMembers;
+
+    return response;
+}
+
+QJsonObject Service::controlKick(QString username)
+{
+    QJsonObject response;
+    Client *client = addressClientMap.value(usernameAddressMap.value(Symbols::find(username)));
+
+    if (client == NULL) {
+        response["error"] = QString("agent is not logged in: %1").arg(username);
+
+        return response;
+    }
+
+    // The client lives on its worker thread
+    QMetaObject::invokeMethod(client, "forceLogout", Qt::QueuedConnection, Q_ARG(QString, "kicked by administrator"));
+
+    qDebug() << "Agent kicked through the control socket:" BOLD BLUE << username << RESET;
+
+    response["kicked"] = username;
+
+    return response;
+}
+
+QJsonObject Service::controlReload(QString target)
+{
+    QJsonObject response;
+
+    QHash<QString, int> commands;
+    commands["all"] = ReloadAll;
+    commands["heartbeat"] = ReloadHeartbeat;
+    commands["database"] = ReloadDatabase;
+    commands["asterisk-filter"] = ReloadAsteriskFilter;
+    commands["fanout"] = ReloadFanout;
+
+    if (target == "directory")
+        loadDirectory();
+    else if (target == "dialer")
+        loadDialAuthorization();
+    else if (commands.contains(target))
+        processCommand(commands.value(target));
+    else
+        response["error"] = QString("unknown reload target: %1").arg(target);
+
+    if (!response.contains("error"))
+        response["reloaded"] = target;
+
+    return response;
+}
+
+QJsonObject Service::controlSnapshot()
+{
+    QJsonObject response;
+
+    if (stateFile == NULL) {
+        response["error"] = QString("state file is not configured");
+
+        return response;
+    }
+
+    // Records are written on every change already, this pushes them and the liveness stamp to disk now
+    stateFile->sync();
+
+    response["synced"] = true;
+
+    return response;
+}
+
 void Service::broadcastAgentStatus(Client *client)
 {
     ;
 }
 
+Queue *Service::queue(QString name)
+{
+    if (!queues.contains(name))
+        queues.insert(name, new Queue(name));
+
+    return queues.value(name);
+}
+
 bool Service::checkGroupIntersected(Client *superior, Client *subordinate)
 {
-    return !superior->getGroups().toSet().intersect(subordinate->getGroups().toSet()).isEmpty();
+    return superior->getMemberships().intersects(subordinate->getMemberships());
+}
+
+Client *Service::acceptClient(QTcpSocket *socket, QByteArray session)
+{
+    QString clientAddress = socket->peerAddress().toString();
+
+    Worker *worker = workers.at(circulateWorkerIndex());
+
+    Client *client = new Client(configuration, &bufferPool);
+    client->setStateFile(stateFile);
+    client->setChannels(events, worker->getDeliveries());
+
+    if (session.isEmpty())
+        client->setSocket(socket);
+    else
+        client->resumeSession(socket, session);
+
+    client->setHeartbeatWheel(worker->getHeartbeatWheel());
+    client->moveToThread(worker);
+
+    // The first deadline is armed from the worker thread, which is the only one touching its wheel
+    QMetaObject::invokeMethod(client, "resetHeartbeatTimer", Qt::QueuedConnection);
+
+    addressClientMap.insert(clientAddress, client);
+
+    Metrics::add(Metrics::WorkerConnections, 1, QString::number(worker->getIndex()));
+
+    qDebug() << "Client connected from:" BOLD BLUE << clientAddress << RESET;
+
+    return client;
+}
+
+void Service::registerLogin(Client *client)
+{
+    int username = client->getUsernameSymbol();
+
+    Metrics::add(Metrics::Logins);
+
+    admission->setLevelHint(client->getUsername(), client->getLevel());
+
+    if (usernameAddressMap.contains(username)) {
+        client->forceLogout("same user login");
+
+        return;
+    }
+
+    usernameAddressMap.insert(username, client->getIpAddress());
+
+    if (client->getExtensionSymbol() != 0)
+        extensionUsernameMap.insert(client->getExtensionSymbol(), username);
+
+    foreach (QString group, client->getGroups()) {
+        if (!groups.contains(group))
+            groups.insert(group, new Group(group, this));
+
+        groups.value(group)->addMember(client);
+    }
+
+    if (distributor != NULL)
+        distributor->updateClient(client, client->getStatus());
+}
+
+void Service::unregisterLogin(Client *client)
+{
+    int username = client->getUsernameSymbol();
+
+    if (usernameAddressMap.value(username) == client->getIpAddress())
+        usernameAddressMap.remove(username);
+
+    foreach (QString group, client->getGroups()) {
+        if (groups.contains(group))
+            groups.value(group)->removeMember(client);
+    }
+}
+
+void Service::releaseClient(Client *client)
+{
+    QString clientAddress = addressClientMap.key(client);
+
+    if (!clientAddress.isEmpty())
+        addressClientMap.remove(clientAddress);
+
+    admission->release(client);
+
+    Worker *worker = qobject_cast<Worker *>(client->thread());
+
+    if (worker != NULL)
+        Metrics::add(Metrics::WorkerConnections, -1, QString::number(worker->getIndex()));
+
+    if (distributor != NULL)
+        distributor->removeClient(client);
+
+    disconnect(client);
+
+    QMutableHashIterator<QString, Spy> spy(pendingSpies);
+
+    // The outcome of a spy still in progress has nobody left to go to
+    while (spy.hasNext()) {
+        spy.next();
+
+        if (spy.value().supervisor == client)
+            spy.remove();
+    }
+
+    // Deleted by its worker once every delivery queued before this one has been handled
+    Client::Delivery delivery;
+    delivery.type = Client::Delivery::Release;
+    delivery.receiver = client;
+
+    client->deliver(delivery);
+}
+
+void Service::changeAgentStatus(Client::Event event)
+{
+    Client *target = addressClientMap.value(usernameAddressMap.value(extensionUsernameMap.value(event.extension)));
+
+    if (target != NULL) {
+        if (checkGroupIntersected(event.client, target)) {
+            Client::Delivery delivery;
+            delivery.type = Client::Delivery::ChangeStatus;
+            delivery.receiver = target;
+            delivery.status = event.status;
+            delivery.outbound = event.outbound;
+            delivery.trace = event.trace;
+
+            target->deliver(delivery);
+        }
+    }
 }
 
 void Service::onServerNewConnection()
 {
-    if (server.hasPendingConnections()) {
-        QTcpSocket *newSocket = server.nextPendingConnection();
-        QString clientAddress = newSocket->peerAddress().toString();
+    if (server.hasPendingConnections())
+        acceptClient(server.nextPendingConnection());
+}
+
+void Service::onHandoffServerNewConnection()
+{
+    QLocalSocket *peer = handoffServer.nextPendingConnection();
 
-        Client *client = new Client;
-        client->setSocket(newSocket);
-        client->moveToThread(workers.at(circulateWorkerIndex()));
+    connect(peer, SIGNAL(disconnected()), peer, SLOT(deleteLater()));
 
-        addressClientMap.insert(clientAddress, client);
+    if (!Handoff::checkPeer(peer->socketDescriptor())) {
+        qWarning("Handoff refused, the peer runs as another user");
 
-        connect(client, SIGNAL(socketDisconnected()), SLOT(onClientSocketDisconnected()));
-        connect(client, SIGNAL(userLoggedIn()), SLOT(onClientUserLoggedIn()));
-        connect(client, SIGNAL(userLoggedOut()), SLOT(onClientUserLoggedOut()));
-        connect(client, SIGNAL(askDialAuthorization(QString,QString,QString)), SLOT(onClientAskDialAuthorization(QString,QString,QString)));
-        connect(client, SIGNAL(spyAgentPhone(QString)), SLOT(onClientSpyAgentPhone(QString)));
-        connect(client, SIGNAL(changeAgentStatus(Client::Status,bool,QString)), SLOT(onClientChangeAgentStatus(Client::Status,bool,QString)));
+        peer->abort();
 
-        qDebug() << "Client connected from:" BOLD BLUE << clientAddress << RESET;
+        return;
     }
+
+    // Anything else connecting here, a probe or a misdirected tool, is dropped unless it greets in time
+    connect(peer, SIGNAL(readyRead()), SLOT(onHandoffPeerReadyRead()));
+
+    QTimer::singleShot(5000, peer, SLOT(deleteLater()));
+}
+
+void Service::onHandoffPeerReadyRead()
+{
+    QLocalSocket *peer = (QLocalSocket *) sender();
+    QByteArray greeting = Handoff::encode(Handoff::greeting());
+
+    if (peer->bytesAvailable() < greeting.size())
+        return;
+
+    disconnect(peer, SIGNAL(readyRead()), this, SLOT(onHandoffPeerReadyRead()));
+
+    if (peer->read(greeting.size()) != greeting) {
+        qWarning("Handoff refused, the peer did not greet with our version");
+
+        peer->abort();
+
+        return;
+    }
+
+    // Nothing follows the greeting until we answer, the descriptor can be used directly from here on
+    Handoff channel(peer->socketDescriptor());
+
+    qDebug("Handing off to a new process");
+
+    server.pauseAccepting();
+
+    if (!channel.send("listener", server.socketDescriptor())) {
+        server.resumeAccepting();
+
+        peer->abort();
+        peer->deleteLater();
+
+        return;
+    }
+
+    // The next process takes over the state file as soon as it has every session
+    stateFile->close();
+
+    int detached = 0;
+
+    QHashIterator<QString, Client *> clientAddress(addressClientMap);
+
+    while (clientAddress.hasNext()) {
+        clientAddress.next();
+
+        Client *client = clientAddress.value();
+        QByteArray session;
+
+        // Each client is cut from its own worker thread, between two messages
+        QMetaObject::invokeMethod(client, "detach", Qt::BlockingQueuedConnection, Q_RETURN_ARG(QByteArray, session));
+
+        if (session.isEmpty())
+            continue;
+
+        int descriptor = client->takeDetachedDescriptor();
+
+        if (channel.send(session, descriptor))
+            detached++;
+
+        ::close(descriptor);
+
+        // Handed off clients are forgotten here, the ones left behind are logged out by stop() below
+        disconnect(client);
+
+        addressClientMap.remove(clientAddress.key());
+        usernameAddressMap.remove(client->getUsernameSymbol());
+    }
+
+    channel.send(QByteArray());
+
+    peer->disconnectFromServer();
+    peer->deleteLater();
+
+    server.close();
+    handoffServer.close();
+
+    qDebug() << "Handoff finished, clients:" BOLD BLUE << detached << RESET;
+
+    // QtService only calls stop() on a terminate command, quitting from here would skip it
+    stop();
+
+    QCoreApplication::quit();
 }
 
 void Service::onAsteriskEventReceived(QString event, QVariantHash headers)
@@ -190,98 +935,401 @@ void Service::onAsteriskEventReceived(QString event, QVariantHash headers)
     if (event == "FullyBooted") {
         asterisk->sipPeers();
         asterisk->coreShowChannels();
+        asterisk->queueStatus();
+    } else if (event == "QueueParams") {
+        queue(headers.value("Queue").toString())->seedParams(headers);
+    } else if (event == "QueueMember") {
+        queue(headers.value("Queue").toString())->seedMember(headers);
+    } else if (event == "QueueEntry") {
+        queue(headers.value("Queue").toString())->seedEntry(headers);
+    } else if (event == "QueueCallerJoin") {
+        queue(headers.value("Queue").toString())->callerJoined(headers);
+    } else if (event == "QueueCallerLeave") {
+        queue(headers.value("Queue").toString())->callerLeft(headers);
+    } else if (event == "QueueCallerAbandon") {
+        queue(headers.value("Queue").toString())->callerAbandoned(headers);
+    } else if (event == "AgentConnect") {
+        queue(headers.value("Queue").toString())->callerConnected(headers);
+    } else if (event == "QueueMemberStatus") {
+        queue(headers.value("Queue").toString())->memberStatusChanged(headers);
     } else if (event == "PeerEntry" || event == "Registry") {
         ;
     } else if (event == "CoreShowChannel" || event == "Newchannel") {
-        ;
+        trackChannel(headers.value("Channel").toString(), true);
+    } else if (event == "Hangup") {
+        trackChannel(headers.value("Channel").toString(), false);
     }
+
+    if (ingestor != NULL && Ingestor::accepts(event))
+        ingestor->enqueue(event, headers);
 }
 
-void Service::onWorkerFinished()
+void Service::onAsteriskLoginFinished(bool succeed, QString message)
 {
-    Worker *worker = (Worker *) sender();
-    worker->deleteLater();
+    if (succeed) {
+        qDebug() << "Asterisk login " BOLD GREEN "Succeed" RESET << message;
 
-    workers.removeAll(worker);
+        readiness->markReady("asterisk");
+    } else {
+        qDebug() << "Asterisk login " BOLD RED "Failed" RESET << message;
 
-    workerCount = workers.count();
-    currentWorkerIndex = 0;
+        QTimer::singleShot(15000, this, SLOT(connectToAsterisk()));
+    }
 }
 
-void Service::onClientSocketDisconnected()
+void Service::onStageRunnable(QString stage)
 {
-    Client *client = (Client *) sender();
-    QString clientAddress = addressClientMap.key(client);
+    if (stage == "asterisk") {
+        connectToAsterisk();
+    } else if (stage == "directory") {
+        loadDirectory();
+    } else if (stage == "dialer") {
+        loadDialAuthorization();
+
+        if (dialAuthorizationTimer.interval() > 0)
+            dialAuthorizationTimer.start();
+    } else if (stage == "database") {
+        openDatabase();
+    } else if (stage == "ingestor") {
+        ingestor->start();
+
+        readiness->markReady(stage);
+    } else if (stage == "acd") {
+        distributor->listen(settings->value("acd/agi_port", 4573).toUInt());
+
+        readiness->markReady(stage);
+    } else if (stage == "server") {
+        // A server resumed from a handoff is listening already
+        if (!server.isListening())
+            startServer();
+
+        readiness->markReady(stage);
+    }
+}
 
-    if (!clientAddress.isEmpty())
-        addressClientMap.remove(clientAddress);
+void Service::onDirectoryFinished()
+{
+    if (!directory->isLoaded()) {
+        qWarning("Directory loading failed, retrying in 15 seconds");
 
-    disconnect(client);
+        QTimer::singleShot(15000, this, SLOT(loadDirectory()));
 
-    client->deleteLater();
+        return;
+    }
+
+    QHash<QString, Client::Level> levels = directory->getLevels();
+    QHashIterator<QString, Client::Level> level(levels);
+
+    while (level.hasNext()) {
+        level.next();
+
+        admission->setLevelHint(level.key(), level.value());
+    }
+
+    readiness->markReady("directory");
 }
 
-void Service::onClientUserLoggedIn()
+void Service::onDialAuthorizationFinished()
 {
-    Client *client = (Client *) sender();
-    QString username = client->getUsername();
+    // A failed reload keeps the previous index in use
+    if (!dialAuthorization->isLoaded()) {
+        qWarning("Dial authorization loading failed, retrying in 15 seconds");
 
-    if (usernameAddressMap.contains(username)) {
-        client->forceLogout("same user login");
+        QTimer::singleShot(15000, this, SLOT(loadDialAuthorization()));
 
         return;
     }
 
-    usernameAddressMap.insert(username, client->getIpAddress());
+    readiness->markReady("dialer");
+}
 
-    foreach (QString group, client->getGroups()) {
-        if (!groups.contains(group))
-            groups.insert(group, new Group(group, this));
+void Service::onQueueTimerTimeout()
+{
+    QHashIterator<QString, Queue *> queue(queues);
+    while (queue.hasNext()) {
+        queue.next();
 
-        groups.value(group)->addMember(client);
+        Group *group = groups.value(queue.key());
+
+        if (group != NULL && queue.value()->isDirty())
+            group->broadcastQueueStatus(queue.value()->takeSnapshot());
     }
 }
 
-void Service::onClientUserLoggedOut()
+void Service::onStateTimerTimeout()
 {
-    Client *client = (Client *) sender();
-    QString username = client->getUsername();
+    stateFile->sync();
+}
 
-    if (usernameAddressMap.contains(username))
-        usernameAddressMap.remove(username);
+void Service::closeOrphanedSessions()
+{
+    QHash<int, StateFile::Record> orphaned = stateFile->takeAllRecovered();
+
+    QHashIterator<int, StateFile::Record> slot(orphaned);
+    while (slot.hasNext()) {
+        slot.next();
+
+        const StateFile::Record &record = slot.value();
+        QDateTime lastAlive = QDateTime::fromMSecsSinceEpoch(record.lastAlive);
+
+        QSqlQuery updateStatus;
+        updateStatus.prepare("UPDATE acd_log_agent_status "
+                             "SET finish = :finish "
+                             "WHERE acd_log_agent_status_id = :agent_log_status_id AND finish IS NULL");
+
+        updateStatus.bindValue(":finish", lastAlive);
+        updateStatus.bindValue(":agent_log_status_id", (quint64) record.agentLogStatusId);
+
+        if (!Metrics::exec(&updateStatus, "close_orphaned_status")) {
+            qWarning() << "Closing orphaned status log failed:" BOLD CYAN << updateStatus.lastError().text() << RESET;
+
+            continue;
+        }
+
+        QSqlQuery updateSession;
+        updateSession.prepare("UPDATE acd_log_agent_session "
+                              "SET logout_time = :logout_time "
+                              "WHERE acd_log_agent_session_id = :agent_log_session_id AND logout_time IS NULL");
+
+        updateSession.bindValue(":logout_time", lastAlive);
+        updateSession.bindValue(":agent_log_session_id", (quint64) record.agentLogSessionId);
+
+        if (!Metrics::exec(&updateSession, "close_orphaned_session")) {
+            qWarning() << "Closing orphaned session log failed:" BOLD CYAN << updateSession.lastError().text() << RESET;
+
+            continue;
+        }
+
+        // A record whose session could not be closed stays in the file for the next start
+        stateFile->release(slot.key());
+    }
+
+    if (!orphaned.isEmpty())
+        qDebug() << "Orphaned sessions closed:" BOLD BLUE << orphaned.count() << RESET;
 }
 
-void Service::onClientUserExtensionChanged(QString extension)
+void Service::onEventWakeupWoken()
 {
-    Client *client = (Client *) sender();
+    Client::Event event;
+
+    // Every event queued since the last wakeup is handled in one go
+    while (events->pop(&event)) {
+        Tracer::record(event.trace, "service.event_queue", event.posted);
+        Tracer::Span span(event.trace, "service.handle_event");
+
+        switch (event.type) {
+        case Client::Event::LoggedIn:
+            registerLogin(event.client);
+
+            break;
+        case Client::Event::LoggedOut:
+            unregisterLogin(event.client);
+
+            break;
+        case Client::Event::StatusChanged:
+            if (distributor != NULL)
+                distributor->updateClient(event.client, event.status);
+
+            break;
+        case Client::Event::PhoneStatusChanged:
+            foreach (QString group, event.client->getGroups()) {
+                if (groups.contains(group))
+                    groups.value(group)->broadcastAgentStatus(event.client, event.trace);
+            }
+
+            break;
+        case Client::Event::ChangeAgentStatus:
+            changeAgentStatus(event);
+
+            break;
+        case Client::Event::ExtensionChanged:
+            extensionUsernameMap.insert(event.extension, event.client->getUsernameSymbol());
+
+            break;
+        case Client::Event::AskAuthentication:
+            admission->request(event.client, event.arguments.value(0));
+
+            break;
+        case Client::Event::AuthenticationFinished:
+            admission->release(event.client);
+
+            break;
+        case Client::Event::AskDialAuthorization:
+            authorizeDial(event);
+
+            break;
+        case Client::Event::SpyAgentPhone:
+            spyAgentPhone(event);
+
+            break;
+        case Client::Event::AskStatistics:
+            sendStatistics(event);
+
+            break;
+        case Client::Event::Disconnected:
+            releaseClient(event.client);
+
+            break;
+        }
+    }
+}
 
-    extensionUsernameMap.insert(extension, client->getUsername());
+void Service::onTraceTimerTimeout()
+{
+    Tracer::flush();
 }
 
-void Service::onClientAskDialAuthorization(QString destination, QString customerId, QString campaign)
+void Service::onWorkerFinished()
 {
-    Client *client = (Client *) sender();
-    client->sendDialerResponse(destination);
+    Worker *worker = (Worker *) sender();
+    worker->deleteLater();
 
-    qDebug() << "User" BOLD BLUE << client->getUsername() << RESET "dialing" BOLD BLUE << destination << RESET;
+    workers.removeAll(worker);
+
+    workerCount = workers.count();
+    currentWorkerIndex = 0;
 }
 
-void Service::onClientSpyAgentPhone(QString agentUsername)
+void Service::authorizeDial(Client::Event event)
 {
-    ;
+    Client *client = event.client;
+    QString destination = event.arguments.value(0),
+            customerId = event.arguments.value(1),
+            campaign = event.arguments.value(2);
+    DialAuthorization::Result result = dialAuthorization->authorize(destination, campaign);
+    QString status = DialAuthorization::verdictText(result.verdict);
+
+    QMetaObject::invokeMethod(client, "sendDialerResponse", Qt::QueuedConnection,
+                              Q_ARG(QString, destination),
+                              Q_ARG(QString, result.dial),
+                              Q_ARG(QString, status),
+                              Q_ARG(QString, result.trunk));
+
+    qDebug() << "User" BOLD BLUE << client->getUsername() << RESET "dialing" BOLD BLUE << destination << RESET
+             << "customer:" BOLD BLUE << customerId << RESET "result:" BOLD BLUE << status << result.dial << RESET;
 }
 
-void Service::onClientChangeAgentStatus(Client::Status status, bool outbound, QString extension)
+void Service::spyAgentPhone(Client::Event event)
 {
-    Client *client = (Client *) sender(),
-           *target = addressClientMap.value(usernameAddressMap.value(extensionUsernameMap.value(extension)));
+    Client *supervisor = event.client;
+    QString agentUsername = event.arguments.value(0),
+            mode = event.arguments.value(1);
+    Client *agent = addressClientMap.value(usernameAddressMap.value(Symbols::find(agentUsername)));
 
-    if (target != NULL) {
-        if (checkGroupIntersected(client, target)) {
-            target->changeStatus(status);
-            target->changePhoneStatus(status == Client::Ready ? "ready" : "aux", outbound);
-        }
+    if (mode != "spy" && mode != "whisper" && mode != "barge") {
+        replySpy(supervisor, agentUsername, mode, false, "unknown mode");
+
+        return;
+    }
+
+    if (agent == NULL) {
+        replySpy(supervisor, agentUsername, mode, false, "agent is not logged in");
+
+        return;
+    }
+
+    if (supervisor->getLevel() <= agent->getLevel() || !checkGroupIntersected(supervisor, agent)) {
+        replySpy(supervisor, agentUsername, mode, false, "not allowed");
+
+        return;
     }
+
+    QString channel = extensionChannelMap.value(agent->getExtensionSymbol());
+
+    if (channel.isEmpty()) {
+        replySpy(supervisor, agentUsername, mode, false, "agent has no live channel");
+
+        return;
+    }
+
+    if (supervisor->getExtension().isEmpty()) {
+        replySpy(supervisor, agentUsername, mode, false, "supervisor has no extension");
+
+        return;
+    }
+
+    // q keeps the beep off, E ends the spy once the agent's channel hangs up
+    QString options = mode == "whisper" ? "qEw" : mode == "barge" ? "qEB" : "qE";
+    QString actionId = asterisk->originateAsync(spyChannel.arg(supervisor->getExtension()), QString(), QString(), 0,
+                                                "ChanSpy", QString("%1,%2").arg(channel, options), spyTimeout,
+                                                agentUsername);
+
+    if (actionId.isEmpty()) {
+        replySpy(supervisor, agentUsername, mode, false, "asterisk is not connected");
+
+        return;
+    }
+
+    Spy spy;
+    spy.supervisor = supervisor;
+    spy.agentUsername = agentUsername;
+    spy.mode = mode;
+
+    pendingSpies.insert(actionId, spy);
+
+    qDebug() << "User" BOLD BLUE << supervisor->getUsername() << RESET "spying on" BOLD BLUE << channel << RESET "mode:" BOLD BLUE << mode << RESET;
+}
+
+void Service::onAsteriskOriginateFinished(QString actionId, bool succeed, QString reason)
+{
+    if (!pendingSpies.contains(actionId))
+        return;
+
+    Spy spy = pendingSpies.take(actionId);
+
+    replySpy(spy.supervisor, spy.agentUsername, spy.mode, succeed, succeed ? QString() : reason);
+}
+
+void Service::replySpy(Client *supervisor, QString agentUsername, QString mode, bool succeed, QString message)
+{
+    QMetaObject::invokeMethod(supervisor, "sendSpyResponse", Qt::QueuedConnection,
+                              Q_ARG(QString, agentUsername),
+                              Q_ARG(QString, mode),
+                              Q_ARG(bool, succeed),
+                              Q_ARG(QString, message));
+}
+
+void Service::trackChannel(QString channel, bool up)
+{
+    // SIP/5042-0000001a belongs to the phone at extension 5042
+    int slash = channel.indexOf('/'),
+        separator = channel.lastIndexOf('-');
+
+    if (slash < 0 || separator <= slash)
+        return;
+
+    int extension = Symbols::find(channel.mid(slash + 1, separator - slash - 1));
+
+    if (extension == 0)
+        return;
+
+    if (up)
+        extensionChannelMap.insert(extension, channel);
+    else if (extensionChannelMap.value(extension) == channel)
+        extensionChannelMap.remove(extension);
+}
+
+void Service::sendStatistics(Client::Event event)
+{
+    Client *client = event.client;
+    QString group = event.arguments.value(0),
+            window = event.arguments.value(1);
+
+    if (client->getLevel() <= Client::Agent)
+        return;
+
+    if (group.isEmpty() && !client->getGroups().isEmpty())
+        group = client->getGroups().first();
+
+    if (!client->getGroups().contains(group) || !groups.contains(group))
+        return;
+
+    Statistics::Report report = groups.value(group)->collectStatistics(Statistics::windowFromText(window));
+
+    QMetaObject::invokeMethod(client, "sendStatistics", Qt::QueuedConnection,
+                              Q_ARG(QString, group),
+                              Q_ARG(QString, window),
+                              Q_ARG(Statistics::Report, report));
 }
 
 void Service::openDatabase()
@@ -293,20 +1341,51 @@ void Service::openDatabase()
             QTimer::singleShot(15000, this, SLOT(openDatabase()));
         } else {
             qDebug("Database connected");
+
+            readiness->markReady("database");
         }
     }
 }
 
+void Service::loadDirectory()
+{
+    if (!directory->isRunning())
+        directory->start();
+}
+
+void Service::loadDialAuthorization()
+{
+    if (!dialAuthorization->isRunning())
+        dialAuthorization->start();
+}
+
 void Service::connectToAsterisk()
 {
     QString username = settings->value("asterisk/username").toString(),
             secret = settings->value("asterisk/secret").toString();
 
-    QVariantHash response = asterisk->login(username, secret);
-    QString message = response["Message"].toString();
+    asterisk->login(username, secret);
+}
 
-    if (response["Response"].toString() == "Success")
-        qDebug() << "Asterisk login " BOLD GREEN "Succeed" RESET << message;
+void Service::onControlRequestReceived(QLocalSocket *socket, QStringList request)
+{
+    QString command = request.first();
+    QJsonObject response;
+
+    if (command == "stats")
+        response = controlStats();
+    else if (command == "agents")
+        response = controlAgents();
+    else if (command == "groups")
+        response = controlGroups();
+    else if (command == "kick" && request.count() > 1)
+        response = controlKick(request.at(1));
+    else if (command == "reload" && request.count() > 1)
+        response = controlReload(request.at(1));
+    else if (command == "snapshot")
+        response = controlSnapshot();
     else
-        qDebug() << "Asterisk login " BOLD RED "Failed" RESET << message;
+        response["error"] = QString("unknown command: %1").arg(request.join(" "));
+
+    controlServer.reply(socket, response);
 }
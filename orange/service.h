@@ -5,8 +5,24 @@
 #include <QSettings>
 #include <QSqlDatabase>
 #include <QTcpServer>
-
+#include <QLocalServer>
+#include <QTimer>
+
+#include "configuration.h"
+#include "bufferpool.h"
+#include "handoff.h"
+#include "statefile.h"
+#include "readiness.h"
+#include "metricsserver.h"
+#include "controlserver.h"
+#include "directory.h"
+#include "dialauthorization.h"
+#include "wakeup.h"
+#include "channel.h"
 #include "asterisk.h"
+#include "admission.h"
+#include "ingestor.h"
+#include "distributor.h"
 #include "worker.h"
 #include "group.h"
 #include "client.h"
@@ -16,6 +32,15 @@ class Service : public QObject, public QtService<QCoreApplication>
     Q_OBJECT
 
 public:
+    // Codes accepted by processCommand, sent with: orange -c <code>
+    enum Command {
+        ReloadAll = 1,
+        ReloadHeartbeat,
+        ReloadDatabase,
+        ReloadAsteriskFilter,
+        ReloadFanout
+    };
+
     Service(int &argc, char **argv);
     ~Service();
 
@@ -26,49 +51,131 @@ protected:
     void stop();
 
     void setupSettings();
+    void setupLogger();
+    void setupMetrics();
+    void setupTracing();
+    void setupControl();
     void setupServer();
     void startServer();
     void setupAsterisk();
+    void setupAdmission();
     void createWorkers();
     void stopWorkers();
     void setupDatabase();
+    void setupIngestor();
+    void setupQueues();
+    void setupDistributor();
+    void setupStateFile();
+    void setupReadiness();
+    void openStateFile();
+
+    void reloadConfiguration();
+    void applyHeartbeat();
+    void applyDatabase();
+    void applyAsteriskFilter();
+    void applyFanout();
+
+    bool resumeHandoff();
+    void listenHandoff();
 
     int circulateWorkerIndex();
 
+    Client *acceptClient(QTcpSocket *socket, QByteArray session = QByteArray());
+    void registerLogin(Client *client);
+    void unregisterLogin(Client *client);
+    void releaseClient(Client *client);
+    void changeAgentStatus(Client::Event event);
+    void authorizeDial(Client::Event event);
+    void spyAgentPhone(Client::Event event);
+    void sendStatistics(Client::Event event);
+    void trackChannel(QString channel, bool up);
+    void replySpy(Client *supervisor, QString agentUsername, QString mode, bool succeed, QString message = QString());
+
     void forceLogoutUsers();
+
+    QJsonObject controlStats();
+    QJsonObject controlAgents();
+    QJsonObject controlGroups();
+    QJsonObject controlKick(QString username);
+    QJsonObject controlReload(QString target);
+    QJsonObject controlSnapshot();
     void broadcastAgentStatus(Client *client);
 
+    Queue *queue(QString name);
+
 private:
+    // A ChanSpy originate waiting for its outcome
+    struct Spy {
+        Client *supervisor;
+        QString agentUsername, mode;
+    };
+
     QSettings *settings;
+    ConfigurationPointer configuration;
+    BufferPool bufferPool;
     QTcpServer server;
+    QLocalServer handoffServer;
+    MetricsServer metricsServer;
+    ControlServer controlServer;
     QSqlDatabase database;
     Asterisk *asterisk;
+    Admission *admission;
+    Ingestor *ingestor;
+    Distributor *distributor;
     QList<Worker *> workers;
     QHash<QString, Group *> groups;
+    QHash<QString, Queue *> queues;
+    QTimer queueTimer;
+    StateFile *stateFile;
+    Readiness *readiness;
+    Directory *directory;
+    DialAuthorization *dialAuthorization;
+    QTimer dialAuthorizationTimer;
+    QTimer stateTimer;
+    QTimer traceTimer;
+    Wakeup *eventWakeup;
+    Channel<Client::Event> *events; // from every worker
     QHash<QString, Client *> addressClientMap; // key: IP Address
-    QHash<QString, QString> usernameAddressMap; // key: Username, value: IP Address
-    QHash<QString, QString> extensionUsernameMap; // key: Extension, value: Username
+    QHash<int, QString> usernameAddressMap; // key: Username symbol, value: IP Address
+    QHash<int, int> extensionUsernameMap; // key: Extension symbol, value: Username symbol
+    QHash<int, QString> extensionChannelMap; // key: Extension symbol, value: live channel of that phone
+    QHash<QString, Spy> pendingSpies; // key: ActionID
+    QString spyChannel;
+    uint spyTimeout;
     int workerCount, currentWorkerIndex;
 
     bool checkGroupIntersected(Client *superior, Client *subordinate);
 
 protected slots:
     void onServerNewConnection();
+    void onHandoffServerNewConnection();
+    void onHandoffPeerReadyRead();
 
     void onAsteriskEventReceived(QString event, QVariantHash headers);
+    void onAsteriskLoginFinished(bool succeed, QString message);
+    void onAsteriskOriginateFinished(QString actionId, bool succeed, QString reason);
+
+    void onStageRunnable(QString stage);
+    void onDirectoryFinished();
+    void onDialAuthorizationFinished();
+
+    void onQueueTimerTimeout();
+
+    void onStateTimerTimeout();
+    void closeOrphanedSessions();
+
+    void onTraceTimerTimeout();
 
     void onWorkerFinished();
 
-    void onClientSocketDisconnected();
-    void onClientUserLoggedIn();
-    void onClientUserLoggedOut();
-    void onClientUserExtensionChanged(QString extension);
-    void onClientAskDialAuthorization(QString destination, QString customerId, QString campaign);
-    void onClientSpyAgentPhone(QString agentUsername);
-    void onClientChangeAgentStatus(Client::Status status, bool outbound, QString extension);
+    void onEventWakeupWoken();
+
+    void onControlRequestReceived(QLocalSocket *socket, QStringList request);
 
 private slots:
     void openDatabase();
+    void loadDirectory();
+    void loadDialAuthorization();
     void connectToAsterisk();
 };
 
@@ -0,0 +1,234 @@
+#include <QDateTime>
+#include <QSet>
+#include <QDebug>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "terminal.h"
+#include "statefile.h"
+
+enum {
+    Magic = 0x4f525354, // "ORST"
+    Version = 2
+};
+
+StateFile::StateFile(QString path, int capacity) :
+    path(path),
+    capacity(qMax(capacity, 1)),
+    descriptor(-1),
+    length(sizeof(Header) + this->capacity * sizeof(Record)),
+    header(NULL),
+    records(NULL)
+{
+}
+
+StateFile::~StateFile()
+{
+    close();
+}
+
+bool StateFile::open()
+{
+    QWriteLocker mapLocker(&mapLock);
+
+    descriptor = ::open(path.toLocal8Bit().constData(), O_RDWR | O_CREAT, 0600);
+
+    if (descriptor < 0) {
+        qWarning() << "State file" BOLD BLUE << path << RESET "could not be opened:" BOLD CYAN << strerror(errno) << RESET;
+
+        return false;
+    }
+
+    struct stat status;
+
+    bool reusable = ::fstat(descriptor, &status) == 0 && (size_t) status.st_size == length;
+
+    if ((!reusable && ::ftruncate(descriptor, length) < 0) ||
+            (header = (Header *) ::mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0)) == MAP_FAILED) {
+        qWarning() << "State file" BOLD BLUE << path << RESET "could not be mapped:" BOLD CYAN << strerror(errno) << RESET;
+
+        header = NULL;
+
+        ::close(descriptor);
+        descriptor = -1;
+
+        return false;
+    }
+
+    records = (Record *) (header + 1);
+
+    QMutexLocker locker(&mutex);
+
+    recovered.clear();
+
+    if (reusable && header->magic == Magic && header->version == Version &&
+            header->capacity == (quint32) capacity && header->recordSize == sizeof(Record))
+        recover();
+
+    QSet<int> kept = recovered.values().toSet();
+
+    // Recovered records stay in their slots until taken over or closed, another crash before that finds them again
+    header->magic = Magic;
+    header->version = Version;
+    header->capacity = capacity;
+    header->recordSize = sizeof(Record);
+    header->lastAlive = QDateTime::currentMSecsSinceEpoch();
+
+    freeSlots.clear();
+
+    for (int i = capacity - 1; i >= 0; --i) {
+        if (kept.contains(i))
+            continue;
+
+        memset(records + i, 0, sizeof(Record));
+
+        freeSlots.append(i);
+    }
+
+    qDebug() << "State file opened, recovered sessions:" BOLD BLUE << recovered.count() << RESET;
+
+    return true;
+}
+
+void StateFile::close()
+{
+    QWriteLocker mapLocker(&mapLock);
+
+    if (header == NULL)
+        return;
+
+    ::msync(header, length, MS_SYNC);
+    ::munmap(header, length);
+    ::close(descriptor);
+
+    header = NULL;
+    records = NULL;
+    descriptor = -1;
+}
+
+int StateFile::allocate()
+{
+    QMutexLocker locker(&mutex);
+
+    if (freeSlots.isEmpty())
+        return -1;
+
+    return freeSlots.takeLast();
+}
+
+void StateFile::release(int slot)
+{
+    if (slot < 0 || slot >= capacity)
+        return;
+
+    Record empty;
+    memset(&empty, 0, sizeof(empty));
+
+    write(slot, empty);
+
+    QMutexLocker locker(&mutex);
+
+    freeSlots.append(slot);
+}
+
+void StateFile::write(int slot, const StateFile::Record &record)
+{
+    QReadLocker mapLocker(&mapLock);
+
+    if (records == NULL || slot < 0 || slot >= capacity)
+        return;
+
+    // Each slot has a single writer, the sequence only guards against a crash in the middle of the copy
+    Record *target = records + slot;
+    quint32 sequence = target->sequence;
+
+    target->sequence = sequence + 1;
+    __sync_synchronize();
+
+    memcpy((char *) target + sizeof(quint32), (const char *) &record + sizeof(quint32), sizeof(Record) - sizeof(quint32));
+
+    __sync_synchronize();
+    target->sequence = sequence + 2;
+}
+
+void StateFile::sync()
+{
+    QReadLocker mapLocker(&mapLock);
+
+    if (header == NULL)
+        return;
+
+    header->lastAlive = QDateTime::currentMSecsSinceEpoch();
+
+    ::msync(header, length, MS_ASYNC);
+}
+
+bool StateFile::takeRecovered(QString username, quint32 agentId, StateFile::Record *record, int *slot)
+{
+    QReadLocker mapLocker(&mapLock);
+    QMutexLocker locker(&mutex);
+
+    if (records == NULL || !recovered.contains(username))
+        return false;
+
+    // An agent id of 0 takes the record whoever it was written for
+    Record found = records[recovered.value(username)];
+
+    if (agentId != 0 && found.agentId != agentId)
+        return false;
+
+    *record = found;
+    *slot = recovered.take(username);
+
+    return true;
+}
+
+QHash<int, StateFile::Record> StateFile::takeAllRecovered()
+{
+    QReadLocker mapLocker(&mapLock);
+    QMutexLocker locker(&mutex);
+
+    QHash<int, Record> orphaned;
+
+    if (records == NULL)
+        return orphaned;
+
+    foreach (int slot, recovered)
+        orphaned.insert(slot, records[slot]);
+
+    recovered.clear();
+
+    return orphaned;
+}
+
+void StateFile::copyText(char *target, int size, const QString &text)
+{
+    QByteArray encoded = text.toUtf8().left(size - 1);
+
+    memset(target, 0, size);
+    memcpy(target, encoded.constData(), encoded.size());
+}
+
+void StateFile::recover()
+{
+    for (int i = 0; i < capacity; ++i) {
+        Record &record = records[i];
+
+        // Torn and empty records are skipped
+        if ((record.sequence & 1) != 0 || record.agentId == 0 || record.agentLogSessionId == 0)
+            continue;
+
+        // Records already recovered once keep the time of the crash they were left by
+        if (record.lastAlive == 0)
+            record.lastAlive = header->lastAlive;
+
+        record.username[sizeof(record.username) - 1] = '\0';
+
+        recovered.insert(QString::fromUtf8(record.username), i);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef STATEFILE_H
+#define STATEFILE_H
+
+#include <QString>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QReadWriteLock>
+
+// Memory mapped table of fixed size agent records, survives a crash of the process through the page cache
+class StateFile
+{
+public:
+    struct Record {
+        quint32 sequence; // odd while the record is being written
+        quint32 agentId, agentExtenMapId;
+        qint32 status;
+        quint64 agentLogSessionId, agentLogStatusId;
+        qint64 login; // msecs since epoch
+        qint64 lastAlive; // msecs since epoch, when the process that wrote it was last seen, 0 while that process runs
+        char username[32];
+        char extension[16];
+        char groups[128]; // comma separated
+        char channel[64];
+    };
+
+    explicit StateFile(QString path, int capacity = 4096);
+    ~StateFile();
+
+    bool open();
+    void close();
+
+    int allocate();
+    void release(int slot);
+    void write(int slot, const Record &record);
+    void sync();
+
+    // The slot of a taken record belongs to the caller, the record stays in it until overwritten or released
+    bool takeRecovered(QString username, quint32 agentId, Record *record, int *slot);
+    QHash<int, Record> takeAllRecovered(); // key: slot
+
+    static void copyText(char *target, int size, const QString &text);
+
+private:
+    struct Header {
+        quint32 magic, version, capacity, recordSize;
+        qint64 lastAlive; // msecs since epoch, refreshed on every sync
+    };
+
+    QString path;
+    int capacity, descriptor;
+    size_t length;
+    Header *header;
+    Record *records;
+    QReadWriteLock mapLock; // held for writing only while mapping or unmapping
+    QMutex mutex;
+    QList<int> freeSlots;
+    QHash<QString, int> recovered; // key: Username, value: slot
+
+    void recover();
+};
+
+#endif // STATEFILE_H
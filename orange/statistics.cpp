@@ -0,0 +1,205 @@
+#include <QDateTime>
+
+#include "statistics.h"
+
+// Mirrors the values of Client::Status without pulling in client.h
+enum {
+    StatusRinging = 10,
+    StatusBusy = 11
+};
+
+Statistics::Counters::Counters() :
+    handled(0),
+    abandoned(0),
+    handleTime(0)
+{
+    for (int i = 0; i < StatusCount; ++i)
+        duration[i] = 0;
+}
+
+void Statistics::Counters::add(const Statistics::Counters &other)
+{
+    for (int i = 0; i < StatusCount; ++i)
+        duration[i] += other.duration[i];
+
+    handled += other.handled;
+    abandoned += other.abandoned;
+    handleTime += other.handleTime;
+}
+
+qint64 Statistics::Counters::averageHandleTime() const
+{
+    return handled > 0 ? handleTime / handled : 0;
+}
+
+Statistics::Statistics(int shiftHours) :
+    bucketCount(qMax(shiftHours, 1) * 3600000 / BucketLength),
+    status(0),
+    statusSince(0),
+    callSince(0),
+    handled(0),
+    abandoned(0)
+{
+}
+
+void Statistics::transition(int status)
+{
+    QMutexLocker locker(&mutex);
+
+    // Buckets are allocated on the first transition, connections that never log in do not pay for them
+    if (buckets.isEmpty()) {
+        buckets.resize(bucketCount);
+
+        for (int i = 0; i < buckets.count(); ++i)
+            buckets[i].start = -1;
+    }
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    if (this->status > 0)
+        addDuration(this->status, statusSince, now);
+
+    if (this->status == StatusRinging && status == StatusBusy) {
+        callSince = now;
+    } else if (this->status == StatusBusy && status != StatusBusy) {
+        Counters &bucket = bucketAt(now);
+        bucket.handled++;
+        bucket.handleTime += now - callSince;
+
+        handled++;
+    } else if (this->status == StatusRinging && status != StatusRinging) {
+        bucketAt(now).abandoned++;
+
+        abandoned++;
+    }
+
+    this->status = status;
+    statusSince = now;
+}
+
+Statistics::Counters Statistics::collect(Statistics::Window window)
+{
+    QMutexLocker locker(&mutex);
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch(),
+           length = window == QuarterHour ? 900000 : window == Hour ? 3600000 : (qint64) bucketCount * BucketLength,
+           since = (now / BucketLength) * BucketLength - length + BucketLength;
+
+    Counters counters;
+
+    foreach (const Bucket &bucket, buckets) {
+        if (bucket.start >= since)
+            counters.add(bucket.counters);
+    }
+
+    // The status in progress has not been accounted into any bucket yet
+    if (status > 0 && status < StatusCount)
+        counters.duration[status] += now - qMax(statusSince, since);
+
+    return counters;
+}
+
+int Statistics::totalHandled()
+{
+    QMutexLocker locker(&mutex);
+
+    return handled;
+}
+
+int Statistics::totalAbandoned()
+{
+    QMutexLocker locker(&mutex);
+
+    return abandoned;
+}
+
+Statistics::Window Statistics::windowFromText(QString text)
+{
+    if (text == "quarter-hour")
+        return QuarterHour;
+    else if (text == "hour")
+        return Hour;
+
+    return Shift;
+}
+
+void Statistics::save(QDataStream &stream)
+{
+    QMutexLocker locker(&mutex);
+
+    stream << (qint32) status << statusSince << callSince << (qint32) handled << (qint32) abandoned;
+    stream << (qint32) buckets.count();
+
+    foreach (const Bucket &bucket, buckets) {
+        stream << bucket.start;
+
+        for (int i = 0; i < StatusCount; ++i)
+            stream << bucket.counters.duration[i];
+
+        stream << (qint32) bucket.counters.handled << (qint32) bucket.counters.abandoned << bucket.counters.handleTime;
+    }
+}
+
+void Statistics::restore(QDataStream &stream)
+{
+    QMutexLocker locker(&mutex);
+
+    qint32 status, handled, abandoned, count;
+
+    stream >> status >> statusSince >> callSince >> handled >> abandoned;
+    stream >> count;
+
+    this->status = status;
+    this->handled = handled;
+    this->abandoned = abandoned;
+
+    // A different shift length on the new side simply drops the buckets, the totals are kept
+    buckets.clear();
+
+    for (int i = 0; i < count; ++i) {
+        Bucket bucket;
+        qint32 bucketHandled, bucketAbandoned;
+
+        stream >> bucket.start;
+
+        for (int j = 0; j < StatusCount; ++j)
+            stream >> bucket.counters.duration[j];
+
+        stream >> bucketHandled >> bucketAbandoned >> bucket.counters.handleTime;
+
+        bucket.counters.handled = bucketHandled;
+        bucket.counters.abandoned = bucketAbandoned;
+
+        if (count == bucketCount)
+            buckets.append(bucket);
+    }
+}
+
+Statistics::Counters &Statistics::bucketAt(qint64 time)
+{
+    qint64 start = (time / BucketLength) * BucketLength;
+    Bucket &bucket = buckets[(start / BucketLength) % buckets.count()];
+
+    if (bucket.start != start) {
+        bucket.start = start;
+        bucket.counters = Counters();
+    }
+
+    return bucket.counters;
+}
+
+void Statistics::addDuration(int status, qint64 from, qint64 to)
+{
+    if (status <= 0 || status >= StatusCount)
+        return;
+
+    from = qMax(from, to - (qint64) buckets.count() * BucketLength);
+
+    while (from < to) {
+        qint64 end = qMin(to, (from / BucketLength + 1) * BucketLength);
+
+        bucketAt(from).duration[status] += end - from;
+
+        from = end;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <QMutex>
+#include <QVector>
+#include <QString>
+#include <QList>
+#include <QMetaType>
+#include <QDataStream>
+
+class Statistics
+{
+public:
+    enum Window {
+        QuarterHour,
+        Hour,
+        Shift
+    };
+
+    enum {
+        StatusCount = 13, // Client::Status values are 1 based, index 0 unused
+        BucketLength = 300000 // msecs
+    };
+
+    struct Counters {
+        qint64 duration[StatusCount]; // msecs spent in each Client::Status
+        int handled, abandoned;
+        qint64 handleTime; // msecs
+
+        Counters();
+
+        void add(const Counters &other);
+        qint64 averageHandleTime() const;
+    };
+
+    struct Entry {
+        QString username;
+        Counters counters;
+    };
+
+    typedef QList<Entry> Report;
+
+    explicit Statistics(int shiftHours = 8);
+
+    void transition(int status);
+    Counters collect(Window window);
+
+    int totalHandled();
+    int totalAbandoned();
+
+    static Window windowFromText(QString text);
+
+    // Carries the whole shift across a process handoff
+    void save(QDataStream &stream);
+    void restore(QDataStream &stream);
+
+private:
+    struct Bucket {
+        qint64 start;
+        Counters counters;
+    };
+
+    QMutex mutex;
+    QVector<Bucket> buckets;
+    int bucketCount, status;
+    qint64 statusSince, callSince;
+    int handled, abandoned;
+
+    Counters &bucketAt(qint64 time);
+    void addDuration(int status, qint64 from, qint64 to);
+};
+
+Q_DECLARE_METATYPE(Statistics::Report)
+
+#endif // STATISTICS_H
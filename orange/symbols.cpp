@@ -0,0 +1,70 @@
+#include <QMutex>
+#include <QHash>
+#include <QAtomicInt>
+#include <QDebug>
+
+#include "terminal.h"
+#include "symbols.h"
+
+static QMutex mutex; // taken by intern() and find() only, lookups by symbol never lock
+static QHash<QString, int> symbols;
+static void *chunks[Symbols::MaxChunks]; // entries never move nor change once published
+static QAtomicInt count(1);
+
+int Symbols::intern(const QString &text)
+{
+    if (text.isEmpty())
+        return 0;
+
+    QMutexLocker locker(&mutex);
+
+    QHash<QString, int>::const_iterator symbol = symbols.constFind(text);
+
+    if (symbol != symbols.constEnd())
+        return symbol.value();
+
+    int next = count.load();
+
+    if (next >= ChunkLength * MaxChunks) {
+        qWarning() << "Symbol table is full, not interning:" BOLD CYAN << text << RESET;
+
+        return 0;
+    }
+
+    if (chunks[next / ChunkLength] == NULL)
+        chunks[next / ChunkLength] = new Entry[ChunkLength];
+
+    Entry &entry = ((Entry *) chunks[next / ChunkLength])[next % ChunkLength];
+    entry.text = text;
+    entry.utf8 = text.toUtf8();
+
+    symbols.insert(text, next);
+
+    // Published last, a symbol handed to another thread always finds its entry filled in
+    count.storeRelease(next + 1);
+
+    return next;
+}
+
+int Symbols::find(const QString &text)
+{
+    QMutexLocker locker(&mutex);
+
+    return symbols.value(text, 0);
+}
+
+QString Symbols::text(int symbol)
+{
+    if (symbol <= 0 || symbol >= count.loadAcquire())
+        return QString();
+
+    return ((Entry *) chunks[symbol / ChunkLength])[symbol % ChunkLength].text;
+}
+
+QByteArray Symbols::utf8(int symbol)
+{
+    if (symbol <= 0 || symbol >= count.loadAcquire())
+        return QByteArray();
+
+    return ((Entry *) chunks[symbol / ChunkLength])[symbol % ChunkLength].utf8;
+}
@@ -0,0 +1,32 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <QString>
+#include <QByteArray>
+
+// Identifiers interned once into stable small ids, their UTF-8 encoding is kept alongside for the wire
+class Symbols
+{
+public:
+    enum {
+        ChunkLength = 1024,
+        MaxChunks = 1024 // a million distinct identifiers, the empty one included
+    };
+
+    // Symbol 0 is the empty string, it is also returned once the table is full
+    static int intern(const QString &text);
+
+    // Never grows the table, 0 for text that was not interned before
+    static int find(const QString &text);
+
+    static QString text(int symbol);
+    static QByteArray utf8(int symbol);
+
+private:
+    struct Entry {
+        QString text;
+        QByteArray utf8;
+    };
+};
+
+#endif // SYMBOLS_H
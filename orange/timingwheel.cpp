@@ -0,0 +1,115 @@
+#include <QTimerEvent>
+
+#include "client.h"
+#include "timingwheel.h"
+
+TimingWheel::Entry::Entry() :
+    previous(NULL),
+    next(NULL),
+    client(NULL),
+    rounds(0)
+{
+}
+
+bool TimingWheel::Entry::isScheduled() const
+{
+    return next != NULL;
+}
+
+TimingWheel::TimingWheel(int timeout, QObject *parent, int tick, int bucketCount) :
+    QObject(parent),
+    buckets(qMax(bucketCount, 1)),
+    current(0),
+    timeoutTicks(1),
+    tick(qMax(tick, 1))
+{
+    for (int i = 0; i < buckets.count(); ++i) {
+        buckets[i].previous = &buckets[i];
+        buckets[i].next = &buckets[i];
+    }
+
+    setTimeout(timeout);
+}
+
+TimingWheel::~TimingWheel()
+{
+    for (int i = 0; i < buckets.count(); ++i) {
+        while (buckets[i].next != &buckets[i])
+            unlink(buckets[i].next);
+    }
+}
+
+void TimingWheel::schedule(TimingWheel::Entry *entry)
+{
+    unlink(entry);
+
+    int slot = (current + timeoutTicks) % buckets.count();
+    Entry *head = &buckets[slot];
+
+    // A timeout of exactly n revolutions lands on the current slot, which is next swept a full revolution later
+    entry->rounds = (timeoutTicks - 1) / buckets.count();
+    entry->previous = head->previous;
+    entry->next = head;
+    head->previous->next = entry;
+    head->previous = entry;
+
+    // The timer is started lazily, from the thread owning the wheel
+    if (!timer.isActive())
+        timer.start(tick, this);
+}
+
+void TimingWheel::cancel(TimingWheel::Entry *entry)
+{
+    unlink(entry);
+}
+
+int TimingWheel::getTimeout()
+{
+    return timeoutTicks * tick / 1000;
+}
+
+void TimingWheel::setTimeout(int timeout)
+{
+    // Deadlines already armed keep their slot, the new timeout applies from the next reset
+    timeoutTicks = qMax((timeout * 1000 + tick - 1) / tick, 1);
+}
+
+void TimingWheel::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != timer.timerId())
+        return;
+
+    current = (current + 1) % buckets.count();
+
+    Entry *head = &buckets[current];
+    QList<Client *> expired;
+
+    for (Entry *entry = head->next; entry != head;) {
+        Entry *next = entry->next;
+
+        if (entry->rounds > 0) {
+            entry->rounds--;
+        } else {
+            unlink(entry);
+
+            expired << entry->client;
+        }
+
+        entry = next;
+    }
+
+    // Expired clients are notified only once the slot has been swept, they may re-arm or go away meanwhile
+    foreach (Client *client, expired)
+        client->heartbeatExpired();
+}
+
+void TimingWheel::unlink(TimingWheel::Entry *entry)
+{
+    if (entry->next == NULL)
+        return;
+
+    entry->previous->next = entry->next;
+    entry->next->previous = entry->previous;
+    entry->previous = NULL;
+    entry->next = NULL;
+}
@@ -0,0 +1,48 @@
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include <QObject>
+#include <QBasicTimer>
+#include <QVector>
+
+class Client;
+
+class TimingWheel : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Intrusive list node embedded in each Client, so that re-arming never allocates
+    struct Entry {
+        Entry *previous, *next;
+        Client *client;
+        int rounds;
+
+        Entry();
+
+        bool isScheduled() const;
+    };
+
+    explicit TimingWheel(int timeout = 20, QObject *parent = 0, int tick = 1000, int bucketCount = 64);
+    ~TimingWheel();
+
+    void schedule(Entry *entry);
+    void cancel(Entry *entry);
+
+    int getTimeout();
+
+public slots:
+    void setTimeout(int timeout);
+
+protected:
+    void timerEvent(QTimerEvent *event);
+
+private:
+    QVector<Entry> buckets; // list heads, each one a circular list of entries
+    QBasicTimer timer;
+    int current, timeoutTicks, tick;
+
+    static void unlink(Entry *entry);
+};
+
+#endif // TIMINGWHEEL_H
@@ -0,0 +1,159 @@
+#include <QDebug>
+#include <QFile>
+#include <QList>
+#include <QAtomicInt>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "terminal.h"
+#include "metrics.h"
+#include "tracer.h"
+
+PerThread<Tracer::Shard> Tracer::shards; // a thread that exits hands its shard, pending spans included, to the next one
+
+static QMutex fileMutex;
+static QFile file;
+static QAtomicInt sampleInterval(0); // every nth request is traced, 0 when tracing is off
+static QAtomicInt requests(0);
+static QAtomicInt traces(0);
+static __thread int threadId = 0; // gettid of the recording thread, cached
+
+Tracer::Span::Span(quint64 trace, const char *name) :
+    trace(trace),
+    name(name),
+    start(trace != 0 ? Metrics::now() : 0)
+{
+}
+
+Tracer::Span::~Span()
+{
+    if (trace != 0)
+        record(trace, name, start);
+}
+
+bool Tracer::configure(double sampleRate, QString path)
+{
+    QMutexLocker locker(&fileMutex);
+
+    sampleInterval.store(0);
+
+    if (file.isOpen())
+        file.close();
+
+    if (sampleRate <= 0 || path.isEmpty())
+        return true;
+
+    file.setFileName(path);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Trace file could not be opened:" BOLD CYAN << file.errorString() << RESET;
+
+        return false;
+    }
+
+    // The closing bracket is optional in the JSON array format, spans can be appended until the process exits
+    file.write("[\n");
+    file.flush();
+
+    sampleInterval.store(qMax(qRound(1 / qMin(sampleRate, 1.0)), 1));
+
+    qDebug() << "Tracing one request in" BOLD BLUE << sampleInterval.load() << RESET "into:" BOLD BLUE << path << RESET;
+
+    return true;
+}
+
+bool Tracer::isEnabled()
+{
+    return sampleInterval.load() > 0;
+}
+
+quint64 Tracer::begin()
+{
+    int interval = sampleInterval.load();
+
+    if (interval <= 0 || (uint) requests.fetchAndAddRelaxed(1) % interval != 0)
+        return 0;
+
+    return (uint) traces.fetchAndAddRelaxed(1) + 1;
+}
+
+void Tracer::record(quint64 trace, const char *name, qint64 start, qint64 end)
+{
+    if (trace == 0)
+        return;
+
+    Record record;
+    record.name = name;
+    record.trace = trace;
+    record.start = start;
+    record.duration = qMax((end < 0 ? Metrics::now() : end) - start, (qint64) 0);
+
+    if (threadId == 0)
+        threadId = syscall(SYS_gettid);
+
+    record.thread = threadId;
+
+    Shard *shard = shards.local();
+
+    QMutexLocker locker(&shard->mutex);
+
+    if (shard->records.count() >= ShardCapacity) {
+        shard->dropped++;
+
+        return;
+    }
+
+    shard->records.append(record);
+}
+
+void Tracer::flush()
+{
+    QMutexLocker fileLocker(&fileMutex);
+
+    if (!file.isOpen())
+        return;
+
+    QByteArray text, pid = QByteArray::number(getpid());
+    int dropped = 0;
+
+    foreach (Shard *shard, shards.all()) {
+        QVector<Record> records;
+
+        // Swapped for an already reserved vector, the recording thread never grows its buffer again
+        records.reserve(ShardCapacity);
+
+        shard->mutex.lock();
+        records.swap(shard->records);
+        dropped += shard->dropped;
+        shard->dropped = 0;
+        shard->mutex.unlock();
+
+        // Spans sharing a trace id are bound into one flow, so the viewer draws the hops between threads
+        foreach (const Record &record, records) {
+            QByteArray trace = QByteArray::number(record.trace);
+
+            text.append("{\"name\":\"").append(record.name)
+                .append("\",\"cat\":\"orange\",\"ph\":\"X\",\"ts\":").append(QByteArray::number(record.start))
+                .append(",\"dur\":").append(QByteArray::number(record.duration))
+                .append(",\"pid\":").append(pid).append(",\"tid\":").append(QByteArray::number(record.thread))
+                .append(",\"bind_id\":").append(trace).append(",\"flow_in\":true,\"flow_out\":true")
+                .append(",\"args\":{\"trace\":").append(trace).append("}},\n");
+        }
+    }
+
+    if (dropped > 0)
+        qWarning() << "Trace spans dropped, shards were full:" BOLD CYAN << dropped << RESET;
+
+    if (text.isEmpty())
+        return;
+
+    file.write(text);
+    file.flush();
+}
+
+Tracer::Shard::Shard() :
+    dropped(0)
+{
+    records.reserve(ShardCapacity);
+}
@@ -0,0 +1,64 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QMutex>
+#include <QVector>
+#include <QString>
+
+#include "perthread.h"
+
+// Sampled request spans kept in per-thread shards, written out in the Chrome trace event format
+class Tracer
+{
+public:
+    enum {
+        ShardCapacity = 4096 // spans per thread between two flushes, the rest are dropped
+    };
+
+    // Recorded when it goes out of scope, costs nothing for an unsampled trace
+    class Span
+    {
+    public:
+        Span(quint64 trace, const char *name);
+        ~Span();
+
+    private:
+        quint64 trace;
+        const char *name;
+        qint64 start;
+    };
+
+    // A rate of 0 turns tracing off, 1 traces every request
+    static bool configure(double sampleRate, QString path);
+    static bool isEnabled();
+
+    // A new trace id, or 0 when this request is not sampled
+    static quint64 begin();
+
+    // Span from start until end, both usecs on the Metrics::now() clock, end defaults to now
+    static void record(quint64 trace, const char *name, qint64 start, qint64 end = -1);
+
+    // Appends every span recorded since the last flush to the trace file
+    static void flush();
+
+private:
+    struct Record {
+        const char *name; // string literals only, never copied
+        quint64 trace;
+        qint64 start, duration;
+        int thread; // a shard outlives its thread, the next one started takes it over
+    };
+
+    // Written by its own thread only, the mutex is contended just while a flush swaps the records out
+    struct Shard {
+        QMutex mutex;
+        QVector<Record> records;
+        int dropped;
+
+        Shard();
+    };
+
+    static PerThread<Shard> shards;
+};
+
+#endif // TRACER_H
@@ -0,0 +1,59 @@
+#include <QSocketNotifier>
+#include <QDebug>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "terminal.h"
+#include "wakeup.h"
+
+Wakeup::Wakeup(QObject *parent) :
+    QObject(parent),
+    descriptor(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    notifier(NULL),
+    armed(0)
+{
+    if (descriptor < 0) {
+        qCritical("Wakeup eventfd could not be created");
+
+        return;
+    }
+
+    // Child of this object, so that it follows it to the consumer thread
+    notifier = new QSocketNotifier(descriptor, QSocketNotifier::Read, this);
+
+    connect(notifier, SIGNAL(activated(int)), SLOT(onNotifierActivated()));
+}
+
+Wakeup::~Wakeup()
+{
+    delete notifier;
+
+    if (descriptor >= 0)
+        ::close(descriptor);
+}
+
+void Wakeup::notify()
+{
+    // Only the first producer after a drain pays for the system call
+    if (!armed.testAndSetOrdered(0, 1))
+        return;
+
+    quint64 value = 1;
+
+    if (::write(descriptor, &value, sizeof(value)) < 0)
+        armed.storeRelease(0);
+}
+
+void Wakeup::onNotifierActivated()
+{
+    quint64 value;
+
+    if (::read(descriptor, &value, sizeof(value)) < 0)
+        return;
+
+    // Disarmed before draining, whatever is pushed from now on wakes us again
+    armed.storeRelease(0);
+
+    emit woken();
+}
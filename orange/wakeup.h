@@ -0,0 +1,32 @@
+#ifndef WAKEUP_H
+#define WAKEUP_H
+
+#include <QObject>
+#include <QAtomicInt>
+
+class QSocketNotifier;
+
+// Wakes the consumer thread of a Channel through an eventfd, at most once until the consumer has drained
+class Wakeup : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Wakeup(QObject *parent = 0);
+    ~Wakeup();
+
+    void notify();
+
+private:
+    int descriptor;
+    QSocketNotifier *notifier;
+    QAtomicInt armed;
+
+private slots:
+    void onNotifierActivated();
+
+signals:
+    void woken();
+};
+
+#endif // WAKEUP_H
@@ -1,24 +1,100 @@
+#include <QTimer>
 #include <QDebug>
 
 #include "terminal.h"
+#include "epolldispatcher.h"
 #include "worker.h"
 
-Worker::Worker(int index) :
+Worker::Worker(int index, int heartbeatTimeout, Backend backend) :
     QThread(),
-    index(index)
+    index(index),
+    heartbeatWheel(new TimingWheel(heartbeatTimeout)),
+    deliveryWakeup(new Wakeup),
+    deliveries(deliveryWakeup),
+    lag(0)
 {
-    qDebug() << "Worker" BOLD BLUE << index << RESET "initalized";
+    // Installed before the thread starts, the event loop of the worker runs on it from the first iteration
+    if (backend == EpollBackend)
+        setEventDispatcher(new EpollDispatcher);
+
+    // One wheel per worker holds every heartbeat deadline of the clients living on this thread
+    heartbeatWheel->moveToThread(this);
+    deliveryWakeup->moveToThread(this);
+
+    // Direct, the wakeup fires on this worker thread and the deliveries are drained right there
+    connect(deliveryWakeup, SIGNAL(woken()), SLOT(onDeliveryWakeupWoken()), Qt::DirectConnection);
+
+    qDebug() << "Worker" BOLD BLUE << index << RESET "initalized with backend:" BOLD BLUE << (backend == EpollBackend ? "epoll" : "qt") << RESET;
 }
 
 Worker::~Worker()
 {
+    delete heartbeatWheel;
+    delete deliveryWakeup;
+
     qDebug() << "Worker" BOLD BLUE << index << RESET "destroyed";
 }
 
+int Worker::getIndex()
+{
+    return index;
+}
+
+int Worker::getLag()
+{
+    return lag.load();
+}
+
+TimingWheel *Worker::getHeartbeatWheel()
+{
+    return heartbeatWheel;
+}
+
+Channel<Client::Delivery> *Worker::getDeliveries()
+{
+    return &deliveries;
+}
+
+void Worker::onDeliveryWakeupWoken()
+{
+    Client::Delivery delivery;
+
+    while (deliveries.pop(&delivery)) {
+        // Released here, after every delivery queued before it, so no receiver is ever left dangling
+        if (delivery.type == Client::Delivery::Release)
+            delete delivery.receiver;
+        else
+            delivery.receiver->handleDelivery(delivery);
+    }
+}
+
+Worker::Backend Worker::backendFromText(QString text)
+{
+    if (text == "epoll")
+        return EpollBackend;
+
+    return QtBackend;
+}
+
+void Worker::onLagTimerTimeout()
+{
+    // However late the probe fires is how long everything else waits on this event loop
+    lag.store((int) qMax(lagClock.restart() - LagInterval, (qint64) 0));
+}
+
 void Worker::run()
 {
     qDebug() << "Worker" BOLD BLUE << index << RESET "running on thread:" BOLD BLUE << currentThreadId() << RESET;
 
+    QTimer lagTimer;
+    lagTimer.setTimerType(Qt::PreciseTimer);
+    lagTimer.setInterval(LagInterval);
+
+    connect(&lagTimer, SIGNAL(timeout()), this, SLOT(onLagTimerTimeout()), Qt::DirectConnection);
+
+    lagClock.start();
+    lagTimer.start();
+
     exec();
 
     qDebug() << "Worker" BOLD BLUE << index << RESET "finished";
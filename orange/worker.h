@@ -2,19 +2,51 @@
 #define WORKER_H
 
 #include <QThread>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+
+#include "timingwheel.h"
+#include "wakeup.h"
+#include "channel.h"
+#include "client.h"
 
 class Worker : public QThread
 {
     Q_OBJECT
 
 public:
-    Worker(int index);
+    enum Backend {
+        QtBackend,
+        EpollBackend
+    };
+
+    Worker(int index, int heartbeatTimeout = 20, Backend backend = QtBackend);
     ~Worker();
 
+    enum {
+        LagInterval = 1000 // msecs between two event loop lag probes
+    };
+
+    int getIndex();
+    int getLag();
+    TimingWheel *getHeartbeatWheel();
+    Channel<Client::Delivery> *getDeliveries();
+
     void run();
 
+    static Backend backendFromText(QString text);
+
 private:
     int index;
+    TimingWheel *heartbeatWheel;
+    Wakeup *deliveryWakeup;
+    Channel<Client::Delivery> deliveries;
+    QElapsedTimer lagClock;
+    QAtomicInt lag; // msecs the last probe fired late
+
+private slots:
+    void onDeliveryWakeupWoken();
+    void onLagTimerTimeout();
 };
 
 #endif // WORKER_H
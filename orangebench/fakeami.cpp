@@ -0,0 +1,116 @@
+#include <QDebug>
+
+#include "fakeami.h"
+
+FakeAmi::FakeAmi(QStringList queues, int eventRate, QObject *parent) :
+    QTcpServer(parent),
+    queues(queues),
+    eventRate(eventRate),
+    dueEvents(0),
+    sequence(0),
+    originates(0)
+{
+    eventTimer.setInterval(TickInterval);
+
+    connect(this, SIGNAL(newConnection()), SLOT(onNewConnection()));
+    connect(&eventTimer, SIGNAL(timeout()), SLOT(onEventTimerTimeout()));
+
+    if (eventRate > 0 && !queues.isEmpty())
+        eventTimer.start();
+}
+
+void FakeAmi::handleAction(QTcpSocket *session, QHash<QString, QString> packet)
+{
+    QString action = packet.value("action").toLower();
+    QByteArray actionId = packet.value("actionid").toUtf8(),
+               response = "Response: Success\r\nActionID: " + actionId + "\r\n";
+
+    if (action == "login")
+        response += "Message: Authentication accepted\r\n";
+    else if (action == "logoff")
+        response = "Response: Goodbye\r\nActionID: " + actionId + "\r\nMessage: Thanks for all the fish.\r\n";
+
+    session->write(response + "\r\n");
+
+    if (action == "originate") {
+        // Asynchronous originates report their outcome through an event carrying the same ActionID
+        session->write("Event: OriginateResponse\r\nActionID: " + actionId + "\r\nResponse: Success\r\n"
+                       "Channel: " + packet.value("channel").toUtf8() + "\r\nReason: 4\r\n"
+                       "Uniqueid: originate." + QByteArray::number(++originates) + "\r\n\r\n");
+    } else if (action == "logoff") {
+        session->disconnectFromHost();
+    }
+}
+
+void FakeAmi::broadcast(QByteArray event)
+{
+    foreach (QTcpSocket *session, sessions)
+        session->write(event);
+}
+
+void FakeAmi::onNewConnection()
+{
+    while (hasPendingConnections()) {
+        QTcpSocket *session = nextPendingConnection();
+
+        connect(session, SIGNAL(readyRead()), SLOT(onSessionReadyRead()));
+        connect(session, SIGNAL(disconnected()), SLOT(onSessionDisconnected()));
+
+        sessions << session;
+
+        session->write("Asterisk Call Manager/5.0.1\r\n");
+
+        qDebug() << "AMI session opened from" << session->peerAddress().toString();
+    }
+}
+
+void FakeAmi::onSessionReadyRead()
+{
+    QTcpSocket *session = (QTcpSocket *) sender();
+
+    while (session->canReadLine()) {
+        QString line = QString::fromUtf8(session->readLine()).trimmed();
+
+        if (!line.isEmpty()) {
+            int separator = line.indexOf(':');
+
+            if (separator > 0)
+                packets[session].insert(line.left(separator).trimmed().toLower(), line.mid(separator + 1).trimmed());
+
+            continue;
+        }
+
+        handleAction(session, packets.take(session));
+    }
+}
+
+void FakeAmi::onSessionDisconnected()
+{
+    QTcpSocket *session = (QTcpSocket *) sender();
+
+    sessions.removeOne(session);
+    packets.remove(session);
+
+    session->deleteLater();
+}
+
+void FakeAmi::onEventTimerTimeout()
+{
+    dueEvents += (double) eventRate * TickInterval / 1000;
+
+    // Callers join a queue and leave it again on the following event, so that queue snapshots keep changing
+    while (dueEvents >= 1) {
+        dueEvents--;
+
+        qint64 call = sequence / 2;
+        QByteArray queue = queues.at(call % queues.count()).toUtf8(),
+                   uniqueId = "bench." + QByteArray::number(call);
+
+        if (sequence % 2 == 0)
+            broadcast("Event: QueueCallerJoin\r\nQueue: " + queue + "\r\nUniqueid: " + uniqueId + "\r\nPosition: 1\r\n\r\n");
+        else
+            broadcast("Event: QueueCallerLeave\r\nQueue: " + queue + "\r\nUniqueid: " + uniqueId + "\r\nPosition: 1\r\n\r\n");
+
+        sequence++;
+    }
+}
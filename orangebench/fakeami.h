@@ -0,0 +1,41 @@
+#ifndef FAKEAMI_H
+#define FAKEAMI_H
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QStringList>
+#include <QTimer>
+#include <QHash>
+
+// Stand-in Asterisk Manager Interface: accepts any login, answers every action and plays queue traffic
+class FakeAmi : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    enum {
+        TickInterval = 10 // msecs
+    };
+
+    FakeAmi(QStringList queues, int eventRate, QObject *parent = 0);
+
+private:
+    QStringList queues;
+    int eventRate; // events per second, to every session
+    double dueEvents;
+    qint64 sequence, originates;
+    QList<QTcpSocket *> sessions;
+    QHash<QTcpSocket *, QHash<QString, QString> > packets; // key: session, the packet being read
+    QTimer eventTimer;
+
+    void handleAction(QTcpSocket *session, QHash<QString, QString> packet);
+    void broadcast(QByteArray event);
+
+private slots:
+    void onNewConnection();
+    void onSessionReadyRead();
+    void onSessionDisconnected();
+    void onEventTimerTimeout();
+};
+
+#endif // FAKEAMI_H
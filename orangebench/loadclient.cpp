@@ -0,0 +1,184 @@
+#include "loadclient.h"
+
+static QByteArray textBetween(const QByteArray &buffer, int from, const char *start, const char *end)
+{
+    int begin = buffer.indexOf(start, from);
+
+    if (begin < 0)
+        return QByteArray();
+
+    begin += qstrlen(start);
+
+    int finish = buffer.indexOf(end, begin);
+
+    return finish < 0 ? QByteArray() : buffer.mid(begin, finish - begin);
+}
+
+LoadClient::LoadClient(int index, LoadClient::Role role, QString username, QString password, bool encrypted, int beatInterval, QObject *parent) :
+    QObject(parent),
+    index(index),
+    role(role),
+    username(username),
+    password(password),
+    encrypted(encrypted),
+    loggedIn(false),
+    ready(false)
+{
+    beatTimer.setInterval(beatInterval * 1000);
+
+    connect(&socket, SIGNAL(connected()), SLOT(onSocketConnected()));
+    connect(&socket, SIGNAL(readyRead()), SLOT(onSocketReadyRead()));
+    connect(&socket, SIGNAL(disconnected()), SLOT(onSocketDisconnected()));
+    connect(&socket, SIGNAL(error(QAbstractSocket::SocketError)), SLOT(onSocketError(QAbstractSocket::SocketError)));
+    connect(&beatTimer, SIGNAL(timeout()), SLOT(onBeatTimerTimeout()));
+}
+
+void LoadClient::open(QHostAddress source, QString host, quint16 port)
+{
+    // Orange keys clients by peer address, every connection comes from its own loopback address
+    socket.bind(source);
+    socket.connectToHost(host, port);
+
+    clock.start();
+}
+
+void LoadClient::sendReady(bool ready)
+{
+    this->ready = ready;
+
+    if (ready)
+        socket.write("<action type=\"ready\"><ready value=\"true\" outbound=\"false\" /></action>\n");
+    else
+        socket.write("<action type=\"ready\"><ready value=\"false\" mode=\"aux\" outbound=\"false\" /></action>\n");
+}
+
+int LoadClient::getIndex()
+{
+    return index;
+}
+
+LoadClient::Role LoadClient::getRole()
+{
+    return role;
+}
+
+QString LoadClient::getUsername()
+{
+    return username;
+}
+
+bool LoadClient::isLoggedIn()
+{
+    return loggedIn;
+}
+
+bool LoadClient::isReady()
+{
+    return ready;
+}
+
+void LoadClient::readAuthentication()
+{
+    // Queued logins get a status before the final one, those are skipped
+    while (!loggedIn) {
+        int status = buffer.indexOf("<status>"),
+            end = buffer.indexOf("</status>", status);
+
+        if (status < 0 || end < 0)
+            return;
+
+        QByteArray value = textBetween(buffer, status, "<status>", "</status>");
+
+        if (value == "ok") {
+            loggedIn = true;
+            beatTimer.start();
+
+            emit loginSucceeded(this, clock.nsecsElapsed() / 1000);
+        } else if (value == "failed") {
+            QByteArray message = textBetween(buffer, status, "<message>", "</message>");
+
+            emit loginFailed(this, QString::fromUtf8(message));
+        }
+
+        buffer.remove(0, end + 9);
+    }
+}
+
+void LoadClient::readAgentStatuses()
+{
+    forever {
+        int start = buffer.indexOf("<agent>");
+
+        if (start < 0) {
+            // Only a tag split across two reads needs to be kept
+            buffer = buffer.right(6);
+
+            return;
+        }
+
+        int end = buffer.indexOf("</agent>", start);
+
+        if (end < 0) {
+            buffer.remove(0, start);
+
+            return;
+        }
+
+        QByteArray agentUsername = textBetween(buffer, start, "<username>", "</username>"),
+                   status = textBetween(buffer, start, "<phone status=\"", "\"");
+
+        emit agentStatusReceived(QString::fromUtf8(agentUsername), QString::fromUtf8(status));
+
+        buffer.remove(0, end + 8);
+    }
+}
+
+void LoadClient::onSocketConnected()
+{
+    QByteArray credentials = (username + ":" + password).toUtf8();
+
+    socket.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?><stream>");
+
+    if (encrypted)
+        socket.write("<authentication type=\"encrypted\">" + credentials.toBase64() + "</authentication>\n");
+    else
+        socket.write("<authentication type=\"plain\">" + credentials + "</authentication>\n");
+}
+
+void LoadClient::onSocketReadyRead()
+{
+    buffer.append(socket.readAll());
+
+    if (!loggedIn)
+        readAuthentication();
+
+    if (!loggedIn || role == Agent) {
+        // Agents only care about their own login, everything else they receive is dropped
+        if (loggedIn)
+            buffer.clear();
+
+        return;
+    }
+
+    readAgentStatuses();
+}
+
+void LoadClient::onSocketDisconnected()
+{
+    loggedIn = false;
+    beatTimer.stop();
+
+    emit closed(this);
+}
+
+void LoadClient::onSocketError(QAbstractSocket::SocketError socketError)
+{
+    // A connection refused or reset before being established never reaches disconnected()
+    if (socket.state() != QAbstractSocket::ConnectedState && !loggedIn && socketError != QAbstractSocket::RemoteHostClosedError)
+        emit loginFailed(this, socket.errorString());
+}
+
+void LoadClient::onBeatTimerTimeout()
+{
+    socket.write("<beat>1</beat>\n");
+}
@@ -0,0 +1,59 @@
+#ifndef LOADCLIENT_H
+#define LOADCLIENT_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QElapsedTimer>
+#include <QTimer>
+
+// One simulated desktop speaking the client protocol, as an agent or a supervisor
+class LoadClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Role {
+        Agent,
+        Supervisor
+    };
+
+    LoadClient(int index, Role role, QString username, QString password, bool encrypted, int beatInterval, QObject *parent = 0);
+
+    void open(QHostAddress source, QString host, quint16 port);
+    void sendReady(bool ready);
+
+    int getIndex();
+    Role getRole();
+    QString getUsername();
+    bool isLoggedIn();
+    bool isReady();
+
+private:
+    int index;
+    Role role;
+    QString username, password;
+    bool encrypted, loggedIn, ready;
+    QTcpSocket socket;
+    QByteArray buffer;
+    QElapsedTimer clock;
+    QTimer beatTimer;
+
+    void readAuthentication();
+    void readAgentStatuses();
+
+private slots:
+    void onSocketConnected();
+    void onSocketReadyRead();
+    void onSocketDisconnected();
+    void onSocketError(QAbstractSocket::SocketError socketError);
+    void onBeatTimerTimeout();
+
+signals:
+    void loginSucceeded(LoadClient *client, qint64 elapsed); // usecs since connecting
+    void loginFailed(LoadClient *client, QString message);
+    void agentStatusReceived(QString username, QString status);
+    void closed(LoadClient *client);
+};
+
+#endif // LOADCLIENT_H
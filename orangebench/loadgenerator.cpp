@@ -0,0 +1,198 @@
+#include <QTextStream>
+#include <QDebug>
+
+#include <stdlib.h>
+#include <algorithm>
+
+#include "loadgenerator.h"
+
+LoadGenerator::LoadGenerator(LoadGenerator::Options options, QObject *parent) :
+    QObject(parent),
+    options(options),
+    opened(0),
+    failed(0),
+    closed(0),
+    actions(0),
+    deliveries(0),
+    dueActions(0),
+    lastTick(0),
+    measureStart(-1)
+{
+    tickTimer.setInterval(TickInterval);
+    tickTimer.setTimerType(Qt::PreciseTimer);
+
+    connect(&tickTimer, SIGNAL(timeout()), SLOT(onTickTimerTimeout()));
+}
+
+void LoadGenerator::start()
+{
+    clock.start();
+    tickTimer.start();
+}
+
+QHostAddress LoadGenerator::sourceAddress(int index)
+{
+    // 127.1.0.1 onwards, skipping the .0 and .255 hosts, all of them land on the loopback interface
+    return QHostAddress((127u << 24) | (1u << 16) | ((index / 250) << 8) | (index % 250 + 1));
+}
+
+QString LoadGenerator::username(int index)
+{
+    return QString("bench%1").arg(index, 5, 10, QChar('0'));
+}
+
+bool LoadGenerator::isSupervisor(int index, int connections, int supervisorShare)
+{
+    return index < connections * supervisorShare / 100;
+}
+
+void LoadGenerator::openConnections(int count)
+{
+    for (int i = 0; i < count && opened < options.connections; ++i, ++opened) {
+        LoadClient::Role role = isSupervisor(opened, options.connections, options.supervisorShare) ? LoadClient::Supervisor : LoadClient::Agent;
+        bool encrypted = (opened % 100) < options.encryptedShare;
+
+        LoadClient *client = new LoadClient(opened, role, username(opened), options.password, encrypted, options.beatInterval, this);
+
+        connect(client, SIGNAL(loginSucceeded(LoadClient*,qint64)), SLOT(onClientLoginSucceeded(LoadClient*,qint64)));
+        connect(client, SIGNAL(loginFailed(LoadClient*,QString)), SLOT(onClientLoginFailed(LoadClient*,QString)));
+        connect(client, SIGNAL(agentStatusReceived(QString,QString)), SLOT(onClientAgentStatusReceived(QString,QString)));
+        connect(client, SIGNAL(closed(LoadClient*)), SLOT(onClientClosed(LoadClient*)));
+
+        client->open(sourceAddress(opened), options.host, options.port);
+
+        clients << client;
+    }
+}
+
+void LoadGenerator::churn(qint64 elapsed)
+{
+    int agents = readyAgents.count() + idleAgents.count();
+
+    dueActions += (double) agents * options.churn / 60 * elapsed / 1000000;
+
+    while (dueActions >= 1 && agents > 0) {
+        dueActions--;
+
+        // Agents toggle between ready and aux, picked at random among those logged in
+        int pick = rand() % agents;
+        bool ready = pick >= readyAgents.count();
+        LoadClient *agent = ready ? idleAgents.takeAt(pick - readyAgents.count()) : readyAgents.takeAt(pick);
+
+        agent->sendReady(ready);
+
+        if (ready)
+            readyAgents << agent;
+        else
+            idleAgents << agent;
+
+        Pending change;
+        change.status = ready ? "ready" : "aux";
+        change.sent = clock.nsecsElapsed() / 1000;
+
+        pending.insert(agent->getUsername(), change);
+
+        if (measureStart >= 0)
+            actions++;
+    }
+}
+
+void LoadGenerator::report()
+{
+    QTextStream out(stdout);
+    double seconds = qMax((double) (clock.nsecsElapsed() / 1000 - measureStart) / 1000000, 0.001);
+
+    out << "load/login connections=" << options.connections << " logged_in=" << loginLatencies.count()
+        << " failed=" << failed << " closed=" << closed << percentiles(loginLatencies) << endl;
+    out << "load/fanout actions=" << actions << " deliveries=" << deliveries
+        << " actions_per_second=" << qRound(actions / seconds) << " deliveries_per_second=" << qRound(deliveries / seconds)
+        << percentiles(fanoutLatencies) << endl;
+}
+
+QString LoadGenerator::percentiles(QVector<qint64> samples)
+{
+    if (samples.isEmpty())
+        return QString();
+
+    std::sort(samples.begin(), samples.end());
+
+    int count = samples.count();
+
+    return QString(" p50_ms=%1 p90_ms=%2 p99_ms=%3 max_ms=%4")
+            .arg(samples.at(count * 50 / 100) / 1000.0)
+            .arg(samples.at(count * 90 / 100) / 1000.0)
+            .arg(samples.at(count * 99 / 100) / 1000.0)
+            .arg(samples.last() / 1000.0);
+}
+
+void LoadGenerator::onTickTimerTimeout()
+{
+    qint64 now = clock.nsecsElapsed() / 1000,
+           elapsed = now - lastTick;
+
+    lastTick = now;
+
+    if (opened < options.connections) {
+        openConnections(qMax((int) ((qint64) options.rampRate * now / 1000000) - opened, 0));
+
+        return;
+    }
+
+    // Fanout figures cover the steady phase only, once every connection has been opened
+    if (measureStart < 0) {
+        measureStart = now;
+
+        qDebug() << "All connections opened, measuring for" << options.duration << "seconds";
+    }
+
+    churn(elapsed);
+
+    if (now - measureStart >= (qint64) options.duration * 1000000) {
+        tickTimer.stop();
+
+        report();
+
+        emit finished();
+    }
+}
+
+void LoadGenerator::onClientLoginSucceeded(LoadClient *client, qint64 elapsed)
+{
+    loginLatencies << elapsed;
+
+    if (client->getRole() == LoadClient::Agent)
+        idleAgents << client;
+}
+
+void LoadGenerator::onClientLoginFailed(LoadClient *client, QString message)
+{
+    failed++;
+
+    if (failed <= 10)
+        qWarning() << "Login of" << client->getUsername() << "failed:" << message;
+}
+
+void LoadGenerator::onClientAgentStatusReceived(QString username, QString status)
+{
+    if (!pending.contains(username))
+        return;
+
+    const Pending &change = pending[username];
+
+    // Statuses sent before the latest change are not matched to it
+    if (change.status != status)
+        return;
+
+    if (measureStart >= 0) {
+        fanoutLatencies << clock.nsecsElapsed() / 1000 - change.sent;
+        deliveries++;
+    }
+}
+
+void LoadGenerator::onClientClosed(LoadClient *client)
+{
+    closed++;
+
+    readyAgents.removeOne(client);
+    idleAgents.removeOne(client);
+}
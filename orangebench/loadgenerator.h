@@ -0,0 +1,77 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QObject>
+#include <QHostAddress>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QVector>
+#include <QHash>
+#include <QList>
+
+#include "loadclient.h"
+
+// Ramps up simulated desktops, churns agent statuses and measures how fast supervisors see them
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        QString host, password;
+        quint16 port;
+        int connections;
+        int supervisorShare, encryptedShare; // percent
+        int beatInterval; // secs
+        int churn; // status changes per agent per minute
+        int rampRate; // connections opened per second
+        int duration; // secs, once every connection has been opened
+    };
+
+    enum {
+        TickInterval = 10 // msecs
+    };
+
+    explicit LoadGenerator(Options options, QObject *parent = 0);
+
+    void start();
+
+    static QHostAddress sourceAddress(int index);
+    static QString username(int index);
+    static bool isSupervisor(int index, int connections, int supervisorShare);
+
+private:
+    struct Pending {
+        QString status;
+        qint64 sent; // usecs on clock
+    };
+
+    Options options;
+    QElapsedTimer clock;
+    QTimer tickTimer;
+    QList<LoadClient *> clients;
+    QList<LoadClient *> readyAgents, idleAgents; // logged in agents, by their last status
+    QHash<QString, Pending> pending; // key: Username, the last status change sent
+    QVector<qint64> loginLatencies, fanoutLatencies; // usecs
+    int opened, failed, closed, actions, deliveries;
+    double dueActions;
+    qint64 lastTick, measureStart;
+
+    void openConnections(int count);
+    void churn(qint64 elapsed);
+    void report();
+
+    static QString percentiles(QVector<qint64> samples);
+
+private slots:
+    void onTickTimerTimeout();
+    void onClientLoginSucceeded(LoadClient *client, qint64 elapsed);
+    void onClientLoginFailed(LoadClient *client, QString message);
+    void onClientAgentStatusReceived(QString username, QString status);
+    void onClientClosed(LoadClient *client);
+
+signals:
+    void finished();
+};
+
+#endif // LOADGENERATOR_H
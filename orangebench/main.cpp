@@ -0,0 +1,177 @@
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QStringList>
+#include <QTextStream>
+#include <QHash>
+#include <QDebug>
+
+#include <sys/resource.h>
+
+#include "loadgenerator.h"
+#include "fakeami.h"
+
+static QTextStream out(stdout);
+
+static void usage()
+{
+    QTextStream err(stderr);
+
+    err << "Usage: orangebench <command> [--option value]..." << endl
+        << endl
+        << "  seed   print SQL creating the tables Orange reads and the benchmark agents" << endl
+        << "         --connections 1000 --supervisors 5 --groups 20 --password bench" << endl
+        << "  ami    run a fake Asterisk Manager Interface playing queue traffic" << endl
+        << "         --port 5038 --groups 20 --events 200" << endl
+        << "  load   open the connections, churn agent statuses and report latencies" << endl
+        << "         --host 127.0.0.1 --port 18279 --connections 1000 --supervisors 5 --encrypted 50" << endl
+        << "         --password bench --beat 10 --churn 6 --ramp 500 --duration 60" << endl
+        << endl
+        << "--supervisors and --encrypted are percentages of the connections, --churn is status" << endl
+        << "changes per agent per minute and --ramp connections opened per second." << endl;
+}
+
+static QHash<QString, QString> parseOptions(QStringList arguments)
+{
+    QHash<QString, QString> options;
+
+    for (int i = 0; i + 1 < arguments.count(); i += 2) {
+        if (arguments.at(i).startsWith("--"))
+            options.insert(arguments.at(i).mid(2), arguments.at(i + 1));
+    }
+
+    return options;
+}
+
+static QString groupName(int index)
+{
+    return QString("bench%1").arg(index, 2, 10, QChar('0'));
+}
+
+static QString quoted(QString text)
+{
+    return "'" + text.replace("'", "''") + "'";
+}
+
+// The benchmark agents, one per connection, with the extension mapped to the source address of that connection
+static void printSeed(int connections, int supervisorShare, int groups, QString password)
+{
+    QString hashedPassword = QCryptographicHash::hash(password.toLatin1(), QCryptographicHash::Md5).toHex();
+
+    out << "CREATE TABLE IF NOT EXISTS acd_agent (acd_agent_id serial PRIMARY KEY, name text UNIQUE, password text, fullname text, level integer);" << endl
+        << "CREATE TABLE IF NOT EXISTS acd_agent_exten_map (acd_agent_exten_map_id serial PRIMARY KEY, extension text, ip_address text UNIQUE);" << endl
+        << "CREATE TABLE IF NOT EXISTS acd_skill (acd_skill_id serial PRIMARY KEY, name text UNIQUE);" << endl
+        << "CREATE TABLE IF NOT EXISTS acd_agent_skill (acd_agent_id integer, acd_skill_id integer, PRIMARY KEY (acd_agent_id, acd_skill_id));" << endl
+        << "CREATE TABLE IF NOT EXISTS acd_queue (acd_queue_id serial PRIMARY KEY, name text UNIQUE);" << endl
+        << "CREATE TABLE IF NOT EXISTS acd_agent_group (acd_agent_id integer, acd_queue_id integer, PRIMARY KEY (acd_agent_id, acd_queue_id));" << endl
+        << "CREATE TABLE IF NOT EXISTS acd_log_agent_session (acd_log_agent_session_id bigserial PRIMARY KEY, acd_agent_id integer, "
+           "acd_agent_exten_map_id integer, login_time timestamp, logout_time timestamp);" << endl
+        << "CREATE TABLE IF NOT EXISTS acd_log_agent_status (acd_log_agent_status_id bigserial PRIMARY KEY, acd_log_agent_session_id bigint, "
+           "acd_agent_status_id integer, start timestamp, finish timestamp);" << endl
+        << "CREATE TABLE IF NOT EXISTS acd_log_cdr (uniqueid text PRIMARY KEY, source text, destination text, destination_context text, "
+           "caller_id text, channel text, destination_channel text, last_application text, start_time timestamp, answer_time timestamp, "
+           "end_time timestamp, duration integer, billable_seconds integer, disposition text, account_code text, user_field text);" << endl
+        << "CREATE TABLE IF NOT EXISTS acd_log_queue (uniqueid text, event text, queue text, channel text, member text, position integer, "
+           "hold_time integer, talk_time integer, reason text, event_time timestamp, PRIMARY KEY (uniqueid, event, event_time));" << endl
+        << endl
+        << "BEGIN;" << endl
+        << "INSERT INTO acd_skill (name) VALUES ('bench') ON CONFLICT DO NOTHING;" << endl;
+
+    for (int i = 0; i < groups; ++i)
+        out << "INSERT INTO acd_queue (name) VALUES (" << quoted(groupName(i)) << ") ON CONFLICT DO NOTHING;" << endl;
+
+    for (int i = 0; i < connections; ++i) {
+        QString username = quoted(LoadGenerator::username(i)),
+                agent = "(SELECT acd_agent_id FROM acd_agent WHERE name = " + username + ")";
+        int level = LoadGenerator::isSupervisor(i, connections, supervisorShare) ? 1 : 0;
+
+        out << "INSERT INTO acd_agent (name, password, fullname, level) VALUES (" << username << ", " << quoted(hashedPassword) << ", "
+            << quoted(QString("Bench Agent %1").arg(i)) << ", " << level << ") "
+               "ON CONFLICT (name) DO UPDATE SET password = EXCLUDED.password, level = EXCLUDED.level;" << endl;
+        out << "INSERT INTO acd_agent_exten_map (extension, ip_address) VALUES (" << quoted(QString::number(50000 + i)) << ", "
+            << quoted(LoadGenerator::sourceAddress(i).toString()) << ") ON CONFLICT DO NOTHING;" << endl;
+        out << "INSERT INTO acd_agent_group (acd_agent_id, acd_queue_id) SELECT " << agent << ", acd_queue_id FROM acd_queue "
+               "WHERE name = " << quoted(groupName(i % qMax(groups, 1))) << " ON CONFLICT DO NOTHING;" << endl;
+        out << "INSERT INTO acd_agent_skill (acd_agent_id, acd_skill_id) SELECT " << agent << ", acd_skill_id FROM acd_skill "
+               "WHERE name = 'bench' ON CONFLICT DO NOTHING;" << endl;
+    }
+
+    out << "COMMIT;" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+    QStringList arguments = application.arguments().mid(1);
+
+    if (arguments.isEmpty()) {
+        usage();
+
+        return 2;
+    }
+
+    QString command = arguments.first();
+    QHash<QString, QString> options = parseOptions(arguments.mid(1));
+
+    int connections = options.value("connections", "1000").toInt(),
+        supervisors = options.value("supervisors", "5").toInt(),
+        groups = qMax(options.value("groups", "20").toInt(), 1);
+    QString password = options.value("password", "bench");
+
+    if (command == "seed") {
+        printSeed(connections, supervisors, groups, password);
+
+        return 0;
+    }
+
+    // Every simulated desktop or AMI session holds a descriptor
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    if (command == "ami") {
+        QStringList queues;
+
+        for (int i = 0; i < groups; ++i)
+            queues << groupName(i);
+
+        quint16 port = options.value("port", "5038").toUShort();
+        FakeAmi ami(queues, options.value("events", "200").toInt());
+
+        if (!ami.listen(QHostAddress::Any, port)) {
+            qCritical() << "Fake AMI could not listen on port" << port << ":" << ami.errorString();
+
+            return 1;
+        }
+
+        qDebug() << "Fake AMI listening on port" << port;
+
+        return application.exec();
+    }
+
+    if (command == "load") {
+        LoadGenerator::Options loadOptions;
+        loadOptions.host = options.value("host", "127.0.0.1");
+        loadOptions.port = options.value("port", "18279").toUShort();
+        loadOptions.password = password;
+        loadOptions.connections = connections;
+        loadOptions.supervisorShare = supervisors;
+        loadOptions.encryptedShare = options.value("encrypted", "50").toInt();
+        loadOptions.beatInterval = qMax(options.value("beat", "10").toInt(), 1);
+        loadOptions.churn = options.value("churn", "6").toInt();
+        loadOptions.rampRate = qMax(options.value("ramp", "500").toInt(), 1);
+        loadOptions.duration = qMax(options.value("duration", "60").toInt(), 1);
+
+        LoadGenerator generator(loadOptions);
+
+        QObject::connect(&generator, SIGNAL(finished()), &application, SLOT(quit()));
+
+        generator.start();
+
+        return application.exec();
+    }
+
+    usage();
+
+    return 2;
+}
@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# End-to-end load generator, fake AMI and seed data
+#
+#-------------------------------------------------
+
+QT       += core network
+QT       -= gui
+
+TARGET = orangebench
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += main.cpp \
+    loadclient.cpp \
+    loadgenerator.cpp \
+    fakeami.cpp
+
+HEADERS += \
+    loadclient.h \
+    loadgenerator.h \
+    fakeami.h
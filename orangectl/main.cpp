@@ -1,8 +1,196 @@
 #include <QCoreApplication>
+#include <QLocalSocket>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+
+enum {
+    Timeout = 5000 // msecs
+};
+
+static QTextStream out(stdout);
+static QTextStream err(stderr);
+
+static void usage()
+{
+    err << "Usage: orangectl [-s socket] <command>" << endl
+        << endl
+        << "Commands:" << endl
+        << "  top [seconds]      live workers, backlogs and database usage" << endl
+        << "  stats              the same figures, once" << endl
+        << "  agents             agents logged in" << endl
+        << "  groups             members of every group" << endl
+        << "  kick <username>    force an agent to log out" << endl
+        << "  reload <target>    all, heartbeat, database, asterisk-filter, fanout, directory or dialer" << endl
+        << "  snapshot           flush the session state file to disk" << endl;
+}
+
+static QJsonObject request(QString path, QString command)
+{
+    QLocalSocket socket;
+    QJsonObject response;
+
+    socket.connectToServer(path);
+
+    if (!socket.waitForConnected(Timeout)) {
+        response["error"] = QString("could not connect to %1: %2").arg(path, socket.errorString());
+
+        return response;
+    }
+
+    socket.write(command.toUtf8() + "\n");
+
+    while (!socket.canReadLine()) {
+        if (!socket.waitForReadyRead(Timeout)) {
+            response["error"] = QString("no response: %1").arg(socket.errorString());
+
+            return response;
+        }
+    }
+
+    return QJsonDocument::fromJson(socket.readLine()).object();
+}
+
+static QString yesNo(QJsonValue value)
+{
+    return value.toBool() ? "yes" : "no";
+}
+
+static void printStats(QJsonObject stats)
+{
+    QJsonObject asterisk = stats["asterisk"].toObject(),
+                database = stats["database"].toObject();
+
+    out << "orange    ready: " << yesNo(stats["ready"])
+        << "  clients: " << stats["clients"].toInt()
+        << "  agents: " << stats["agents"].toInt()
+        << "  event backlog: " << stats["events"].toInt() << endl;
+    out << "asterisk  connected: " << yesNo(asterisk["connected"])
+        << "  pending actions: " << asterisk["pending_actions"].toInt() << endl;
+    out << "database  open: " << yesNo(database["open"])
+        << "  logins: " << database["active"].toInt() << "/" << database["concurrency"].toInt()
+        << "  queued: " << database["queued"].toInt() << endl;
+    out << endl;
+
+    out << qSetFieldWidth(8) << right << "worker" << qSetFieldWidth(13) << "connections"
+        << qSetFieldWidth(8) << "lag ms" << qSetFieldWidth(12) << "deliveries" << qSetFieldWidth(0) << endl;
+
+    foreach (QJsonValue value, stats["workers"].toArray()) {
+        QJsonObject worker = value.toObject();
+
+        out << qSetFieldWidth(8) << worker["index"].toInt() << qSetFieldWidth(13) << worker["connections"].toInt()
+            << qSetFieldWidth(8) << worker["lag_ms"].toInt() << qSetFieldWidth(12) << worker["deliveries"].toInt()
+            << qSetFieldWidth(0) << endl;
+    }
+}
+
+static void printAgents(QJsonObject agents)
+{
+    out << left;
+
+    foreach (QJsonValue value, agents["agents"].toArray()) {
+        QJsonObject agent = value.toObject();
+        QStringList groups;
+
+        foreach (QJsonValue group, agent["groups"].toArray())
+            groups << group.toString();
+
+        out << qSetFieldWidth(20) << agent["username"].toString()
+            << qSetFieldWidth(3) << agent["level"].toInt()
+            << qSetFieldWidth(12) << agent["status"].toString()
+            << qSetFieldWidth(10) << agent["extension"].toString()
+            << qSetFieldWidth(18) << agent["address"].toString()
+            << qSetFieldWidth(4) << agent["worker"].toInt()
+            << qSetFieldWidth(0) << groups.join(",") << endl;
+    }
+}
+
+static void printGroups(QJsonObject groups)
+{
+    QJsonObject members = groups["groups"].toObject();
+
+    foreach (QString group, members.keys()) {
+        QStringList usernames;
+
+        foreach (QJsonValue username, members[group].toArray())
+            usernames << username.toString();
+
+        usernames.sort();
+
+        out << group << ": " << usernames.join(", ") << endl;
+    }
+}
+
+static int top(QString path, int interval)
+{
+    forever {
+        QJsonObject stats = request(path, "stats");
+
+        if (stats.contains("error")) {
+            err << stats["error"].toString() << endl;
+
+            return 1;
+        }
+
+        // Clears the terminal and redraws from the top left corner
+        out << "\033[2J\033[H";
+        printStats(stats);
+        out.flush();
+
+        QThread::sleep(interval);
+    }
+
+    return 0;
+}
 
 int main(int argc, char *argv[])
 {
-    QCoreApplication a(argc, argv);
+    QCoreApplication application(argc, argv);
+    QStringList arguments = application.arguments().mid(1);
+    QString path = "/var/run/orange.control";
+
+    if (arguments.count() >= 2 && arguments.first() == "-s") {
+        path = arguments.at(1);
+        arguments = arguments.mid(2);
+    }
+
+    if (arguments.isEmpty()) {
+        usage();
+
+        return 2;
+    }
+
+    QString command = arguments.first();
+
+    if (command == "top")
+        return top(path, arguments.count() > 1 ? qMax(arguments.at(1).toInt(), 1) : 1);
+
+    if (command != "stats" && command != "agents" && command != "groups" && command != "kick" &&
+            command != "reload" && command != "snapshot") {
+        usage();
+
+        return 2;
+    }
+
+    QJsonObject response = request(path, arguments.join(" "));
+
+    if (response.contains("error")) {
+        err << response["error"].toString() << endl;
+
+        return 1;
+    }
+
+    if (command == "stats")
+        printStats(response);
+    else if (command == "agents")
+        printAgents(response);
+    else if (command == "groups")
+        printGroups(response);
+    else
+        out << "ok" << endl;
 
-    return a.exec();
+    return 0;
 }